@@ -4,6 +4,8 @@
 #include <stdint.h>
 #include <iostream>
 #include <cstddef>
+#include <vector>
+#include <unordered_map>
 
 // See http://www.emulator101.com.s3-website-us-east-1.amazonaws.com/6502-addressing-modes/
 namespace Addressing
@@ -101,7 +103,7 @@ struct OpCode
 };
 
 // See http://www.atarimax.com/jindroush.atari.org/aopc.html#STA
-const OpCode opCodes[] =
+constexpr OpCode opCodes[] =
 {
 	{Addressing::Implicit,			Instruction::BRK,		7,	false	},	// $00
 	{Addressing::IndirectX,			Instruction::ORA,		6,	false	},	// $01
@@ -394,6 +396,17 @@ class Memory
 		virtual void Write(const MemoryByte&mb) = 0;
 		void Load(std::istream &is);
 		void Dump(std::ostream &os);
+		
+		//Accessors used by MachineT. These go through the virtual
+		//operator[] and hooks; a derived memory instantiated directly
+		//with MachineT may hide them with plain inline array accesses.
+		inline uint8_t ReadByte(uint16_t address);
+		inline void WriteByte(uint16_t address, uint8_t value);
+		
+		//Returns the backing store of a page whose contents can never change
+		//(ROM), or 0 if the page may be written. MachineT only keeps decoded
+		//instructions for such pages.
+		const uint8_t *ImmutablePage(uint8_t page){ return 0; }
 };
 
 class MemoryByte
@@ -429,25 +442,150 @@ class MemoryByte
 	MemoryByte(Memory *m) : ptr(0), wptr(0), addr(0), mem(m) {};
 };
 
-class Machine
+inline uint8_t Memory::ReadByte(uint16_t address)
+{
+	return (*this)[address];
+}
+
+inline void Memory::WriteByte(uint16_t address, uint8_t value)
+{
+	(*this)[address] = value;
+}
+
+//Machine state before an instruction, as recorded by a TRACE build.
+//FormatTrace turns one into a line in the format of VICE's trace.
+struct TraceRecord
+{
+	uint16_t pc;
+	uint8_t opCode, operandA, operandB;
+	uint8_t a, x, y, s, p;
+};
+
+void FormatTrace(const TraceRecord &record, char *line);
+
+//Bytes taken by an instruction with the addressing, opcode included
+unsigned int Length(Addressing::Type addressing);
+
+//The memory type is a template parameter so that a concrete memory can
+//have its accesses inlined; Machine is the instantiation over the
+//abstract, virtual Memory interface
+template<class MemoryType>
+class MachineT
 {
 	public:
 		FILE *log_file;
-		Memory &memory;
+		MemoryType &memory;
 		struct Registers
 		{
 			uint8_t a, x, y, p, s;	// Accumulator, X index, Y index, Processor status, Stack pointer
 			uint16_t pc;			// Program counter
+			#ifdef LAZY_FLAGS
+			uint8_t nz;				// Last result, N and Z of p are derived from it
+			bool nzPending;			// Whether N and Z of p are out of date
+			#endif
 		};
 		Registers registers;
 		
+		//Sets N and Z from a result. With LAZY_FLAGS only the result is
+		//kept, and registers.p is brought up to date by SyncFlags, which
+		//must be called before inspecting registers.p from outside.
+		inline void SetNZ(uint8_t result)
+		{
+			#ifdef LAZY_FLAGS
+			registers.nz = result;
+			registers.nzPending = true;
+			#else
+			registers.p &= ~(Flags::Sign | Flags::Zero);
+			if((result & 0x80u) != 0) registers.p |= Flags::Sign;
+			if(result == 0) registers.p |= Flags::Zero;
+			#endif
+		}
+		
+		inline void SyncFlags()
+		{
+			#ifdef LAZY_FLAGS
+			if(!registers.nzPending) return;
+			registers.p &= ~(Flags::Sign | Flags::Zero);
+			registers.p |= registers.nz & Flags::Sign;
+			if(registers.nz == 0) registers.p |= Flags::Zero;
+			registers.nzPending = false;
+			#endif
+		}
+		
+		//An instruction with its operands already fetched
+		struct Decoded
+		{
+			uint8_t opCode, operandA, operandB;
+			uint8_t length;
+			bool valid;
+		};
+		
+		//Decoded instructions of immutable pages, indexed by address.
+		//decodedFrom records which backing store each page was decoded
+		//from, so a change in banking drops the page's entries.
+		std::vector<Decoded> decodeCache;
+		const uint8_t *decodedFrom[256];
+		
 		void Dump(std::ostream &os);
 		unsigned int DoStep();
 		
-		Machine(Memory &m) :
+		void Decode(uint16_t pc, Decoded &d);
+		const Decoded *Fetch(uint16_t pc, Decoded &uncached);
+		void FlushDecodeCache();
+		
+		//One bit per address at which Run returns before executing it
+		uint8_t stops[0x10000 / 8];
+		
+		inline void SetStop(uint16_t pc){ stops[pc >> 3] |= 1u << (pc & 7u); }
+		inline void ClearStop(uint16_t pc){ stops[pc >> 3] &= ~(1u << (pc & 7u)); }
+		inline bool IsStop(uint16_t pc) const{ return stops[pc >> 3] & (1u << (pc & 7u)); }
+		
+		enum StopReason
+		{
+			StopAddress,	// registers.pc is in stops
+			CycleBudget		// The budget ran out first
+		};
+		struct RunResult
+		{
+			StopReason reason;
+			unsigned long long cycles;
+		};
+		
+		RunResult Run(unsigned long long budget);
+		
+		//Native replacement for the routine at an address, which Run calls
+		//instead of interpreting it. It has the same effect on memory and
+		//registers including the final RTS, and sets cycles to what the
+		//routine would have taken. Returning false leaves the routine to
+		//be interpreted. Hooks are not called while tracing.
+		typedef bool (*Hook)(MachineT &machine, unsigned int &cycles);
+		std::unordered_map<uint16_t, Hook> hooks;
+		
+		void SetHook(uint16_t pc, Hook hook);
+		void ReturnFromHook();
+		
+		//With TRACE every instruction is recorded in a ring buffer of the
+		//last TraceLength ones, which is written out to log_file as it
+		//fills up. Without TRACE the core has no tracing code at all.
+		#ifdef TRACE
+		static const unsigned int TraceLength = 4096;
+		TraceRecord trace[TraceLength];
+		unsigned long long traceCount, traceFlushed;
+		
+		void Trace(const Decoded &decoded);
+		#endif
+		void FlushTrace();
+		
+		MachineT(MemoryType &m) :
 			log_file(0),
 			memory(m),
-			registers{}
+			registers{},
+			decodedFrom{},
+			stops{}
+			#ifdef TRACE
+			, traceCount(0),
+			traceFlushed(0)
+			#endif
 		{
 		}
 		
@@ -461,4 +599,6 @@ class Machine
 		void Loadstate(FILE *f);
 };
 
+typedef MachineT<Memory> Machine;
+
 #endif
@@ -0,0 +1,812 @@
+#ifndef _6502_IMPL_H
+#define _6502_IMPL_H
+
+// Definitions of the MachineT members. Included by each translation unit
+// that explicitly instantiates MachineT for a memory type.
+
+#include "6502.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <iomanip>
+
+#define bit0  0x1u
+#define bit1  0x2u
+#define bit2  0x4u
+#define bit3  0x8u
+#define bit4  0x10u
+#define bit5  0x20u
+#define bit6  0x40u
+#define bit7  0x80u
+#define bit8  0x100u
+#define bit9  0x200u
+#define bit10 0x400u
+#define bit11 0x800u
+#define bit12 0x1000u
+#define bit13 0x2000u
+#define bit14 0x4000u
+#define bit15 0x8000u
+
+template<class MemoryType>
+void MachineT<MemoryType>::Dump(std::ostream &os)
+{
+	SyncFlags();
+	os << "A  :" << std::setfill('0') << std::setw(2) << std::hex << int(registers.a) << '\n';
+	os << "X  :" << std::setfill('0') << std::setw(2) << std::hex << int(registers.x) << '\n';
+	os << "Y  :" << std::setfill('0') << std::setw(2) << std::hex << int(registers.y) << '\n';
+	os << "S  :" << std::setfill('0') << std::setw(2) << std::hex << int(registers.s) << '\n';
+	os << "P  :" << std::setfill('0') << std::setw(2) << std::hex << int(registers.p) << '\n';
+	os << "PC :" << std::setfill('0') << std::setw(4) << std::hex << int(registers.pc) << '\n';
+}
+
+template<class MemoryType>
+inline void MachineT<MemoryType>::Decode(uint16_t pc, Decoded &d)
+{
+	d.opCode = memory.ReadByte(pc);
+	d.operandA = 0u;
+	d.operandB = 0u;
+	d.length = 1;
+	d.valid = true;
+	
+	switch(opCodes[d.opCode].addressing){
+		case Addressing::Accumulator:
+		case Addressing::Implicit:
+			break;
+		
+		case Addressing::ZeroPage:
+		case Addressing::ZeroPageX:
+		case Addressing::ZeroPageY:
+		case Addressing::IndirectX:
+		case Addressing::IndirectY:
+		case Addressing::Relative:
+		case Addressing::Immediate:
+			d.operandA = memory.ReadByte(pc + 1u);
+			d.length += 1u;
+			break;
+		
+		case Addressing::AbsoluteX:
+		case Addressing::AbsoluteY:
+		case Addressing::Indirect:
+		case Addressing::Absolute:
+			d.operandA = memory.ReadByte(pc + 1u);
+			d.operandB = memory.ReadByte(pc + 2u);
+			d.length += 2u;
+			break;
+		
+		case Addressing::Unknown:
+			break;
+	}
+}
+
+template<class MemoryType>
+inline const typename MachineT<MemoryType>::Decoded *MachineT<MemoryType>::Fetch(uint16_t pc, Decoded &uncached)
+{
+	#ifdef DECODE_CACHE
+	uint8_t page = pc >> 8;
+	const uint8_t *backing = memory.ImmutablePage(page);
+	
+	if(backing && decodedFrom[page] == backing){
+		Decoded &d = decodeCache[pc];
+		if(d.valid) return &d;
+	}
+	
+	//Instructions whose operands run into the next page are not cached,
+	//as that page may be mapped differently later on
+	if(!backing || (pc & 0xFFu) > 0xFDu){
+		Decode(pc, uncached);
+		return &uncached;
+	}
+	
+	if(decodedFrom[page] != backing){
+		if(decodeCache.empty()) decodeCache.resize(0x10000);
+		for(size_t i = 0; i < 0x100; i++){
+			decodeCache[(page << 8) | i].valid = false;
+		}
+		decodedFrom[page] = backing;
+	}
+	
+	Decoded &d = decodeCache[pc];
+	Decode(pc, d);
+	return &d;
+	#else
+	Decode(pc, uncached);
+	return &uncached;
+	#endif
+}
+
+template<class MemoryType>
+void MachineT<MemoryType>::FlushDecodeCache()
+{
+	for(size_t page = 0; page < 256; page++){
+		decodedFrom[page] = 0;
+	}
+}
+
+//Runs until registers.pc is a stop address or at least budget cycles
+//have been used. The budget may be overrun by the last instruction.
+template<class MemoryType>
+typename MachineT<MemoryType>::RunResult MachineT<MemoryType>::Run(unsigned long long budget)
+{
+	unsigned long long cycles = 0;
+	while(true){
+		if(IsStop(registers.pc)){
+			typename std::unordered_map<uint16_t, Hook>::iterator it = hooks.find(registers.pc);
+			if(it == hooks.end()) return RunResult{StopAddress, cycles};
+			
+			unsigned int used = 0;
+			if(!log_file && it->second(*this, used)){
+				cycles += used;
+				continue;
+			}
+		}
+		if(cycles >= budget) return RunResult{CycleBudget, cycles};
+		cycles += DoStep();
+	}
+}
+
+//Hooked addresses are stops, so that Run only looks hooks up there
+template<class MemoryType>
+void MachineT<MemoryType>::SetHook(uint16_t pc, Hook hook)
+{
+	hooks[pc] = hook;
+	SetStop(pc);
+}
+
+//Does the RTS ending a hooked routine
+template<class MemoryType>
+void MachineT<MemoryType>::ReturnFromHook()
+{
+	registers.pc = memory.ReadByte(0x0100u | ((++registers.s) & 0xFFu));
+	registers.pc |= memory.ReadByte(0x0100u | ((++registers.s) & 0xFFu)) << 8u;
+	registers.pc++;
+}
+
+#ifdef TRACE
+template<class MemoryType>
+void MachineT<MemoryType>::Trace(const Decoded &decoded)
+{
+	SyncFlags();
+	TraceRecord &record = trace[traceCount++ % TraceLength];
+	record.pc = registers.pc;
+	record.opCode = decoded.opCode;
+	record.operandA = decoded.operandA;
+	record.operandB = decoded.operandB;
+	record.a = registers.a;
+	record.x = registers.x;
+	record.y = registers.y;
+	record.s = registers.s;
+	record.p = registers.p;
+	if(log_file && traceCount - traceFlushed == TraceLength) FlushTrace();
+}
+#endif
+
+//Writes the records not yet written to log_file, oldest first. Those
+//overwritten in the ring buffer in the meantime are lost.
+template<class MemoryType>
+void MachineT<MemoryType>::FlushTrace()
+{
+	#ifdef TRACE
+	if(traceCount - traceFlushed > TraceLength) traceFlushed = traceCount - TraceLength;
+	if(log_file){
+		while(traceFlushed != traceCount){
+			unsigned int first = traceFlushed % TraceLength;
+			unsigned int count = traceCount - traceFlushed;
+			if(count > TraceLength - first) count = TraceLength - first;
+			fwrite(trace + first, sizeof(TraceRecord), count, log_file);
+			traceFlushed += count;
+		}
+	}
+	traceFlushed = traceCount;
+	#endif
+}
+
+template<class MemoryType>
+unsigned int MachineT<MemoryType>::DoStep()
+{
+	Decoded uncached;
+	const Decoded &decoded = *Fetch(registers.pc, uncached);
+	uint8_t opCode = decoded.opCode;
+	uint16_t address = 0u;
+	uint8_t value = 0u;
+	bool pageBoundaryCrossed = false;
+	unsigned int cycles = 0;
+	unsigned int length = decoded.length;
+	uint8_t operandA = decoded.operandA, operandB = decoded.operandB, temp8;
+	
+	#ifdef TRACE
+	Trace(decoded);
+	#endif
+	
+	cycles += opCodes[opCode].cycles;
+	
+	//AVOIDS: reading value to cause instructions such as STA $PPUDATA,
+	//that wouldn't READ the memory, to do so
+	bool lazy_value = false;
+	
+	switch(opCodes[opCode].addressing){
+		case Addressing::Accumulator:
+			value = registers.a;
+			break;
+
+		case Addressing::Immediate:
+			value = operandA;
+			break;
+
+		case Addressing::Relative:
+			address = registers.pc + 2u;
+			value = operandA;
+			break;
+
+		case Addressing::Implicit:
+			break;
+
+		case Addressing::Absolute:
+			address = operandA | (operandB << 8u);
+			/*value = memory.ReadByte(address);*/lazy_value = true;
+			break;
+
+		case Addressing::ZeroPage:
+			address = operandA;
+			/*value = memory.ReadByte(address);*/lazy_value = true;
+			
+			break;
+
+		case Addressing::Indirect:
+			address = operandA | (operandB << 8u);
+			address =
+				memory.ReadByte(address) |
+				(memory.ReadByte((address & 0xFF00u) | ((address + 1u) & 0xFFu)) << 8u);
+			break;
+
+		case Addressing::AbsoluteX:
+			address = operandA | (operandB << 8u);
+			if(temp8 = ~(address & 0xFFu), temp8 <= registers.x) pageBoundaryCrossed = true;
+			address += registers.x;
+			/*value = memory.ReadByte(address);*/lazy_value = true;
+			break;
+
+		case Addressing::AbsoluteY:
+			address = operandA | (operandB << 8u);
+			if(temp8 = ~(address & 0xFFu), temp8 <= registers.y) pageBoundaryCrossed = true;
+			address += registers.y;
+			/*value = memory.ReadByte(address);*/lazy_value = true;
+			break;
+
+		case Addressing::ZeroPageX:
+			address = (operandA + registers.x) & 0xFFu;
+			/*value = memory.ReadByte(address);*/lazy_value = true;
+			break;
+
+		case Addressing::ZeroPageY:
+			address = (operandA + registers.y) & 0xFFu;
+			/*value = memory.ReadByte(address);*/lazy_value = true;
+			break;
+
+		case Addressing::IndirectX:
+			address =
+				memory.ReadByte((operandA + registers.x) & 0xFFu) |
+				(memory.ReadByte((operandA + registers.x + 1u) & 0xFFu) << 8u);
+			/*value = memory.ReadByte(address);*/lazy_value = true;
+			break;
+
+		case Addressing::IndirectY:
+			address = operandA;
+			address =
+				memory.ReadByte(address) |
+				(memory.ReadByte((address & 0xFF00u) | ((address + 1u) & 0xFFu)) << 8u);
+			if(temp8 = ~(address & 0xFFu), temp8 <= registers.y) pageBoundaryCrossed = true;
+			address += registers.y;
+			/*value = memory.ReadByte(address);*/lazy_value = true;
+			break;
+
+		case Addressing::Unknown:
+			break;
+	}
+	
+	if(pageBoundaryCrossed && opCodes[opCode].pageBoundaryPenalty) cycles++;
+	registers.pc += length;
+
+	uint16_t temp;
+	switch(opCodes[opCode].instruction){
+		case Instruction::ADC:
+			if(lazy_value) value = memory.ReadByte(address);
+			temp = registers.a + value + (registers.p & 1u);
+			registers.p &= ~(Flags::Carry | Flags::Overflow);
+			if(temp > 0xFFu) registers.p |= Flags::Carry;
+			if(((~(registers.a ^ value)) & (registers.a ^ temp) & 0x80u) != 0) registers.p |= Flags::Overflow;
+			SetNZ(temp & 0xFFu);
+			registers.a = temp & 0xFFu;
+			break;
+
+		case Instruction::AND:
+			if(lazy_value) value = memory.ReadByte(address);
+			temp = registers.a & value;
+			SetNZ(temp & 0xFFu);
+			registers.a = temp & 0xFFu;
+			break;
+			
+		case Instruction::ATX:
+			if(lazy_value) value = memory.ReadByte(address);
+			//https://forums.nesdev.com/viewtopic.php?f=3&t=10698#p121064
+			//temp = registers.a & value;
+			temp = value;
+			SetNZ(temp & 0xFFu);
+			registers.a = temp & 0xFFu;
+			registers.x = registers.a;
+			break;
+		
+		case Instruction::AXS:
+			if(lazy_value) value = memory.ReadByte(address);
+			temp = (registers.a & registers.x) - value;
+			registers.p &= ~Flags::Carry;
+			if(!(temp > 0xFFu)) registers.p |= Flags::Carry;
+			SetNZ(temp & 0xFFu);
+			registers.x = temp & 0xFFu;
+			break;
+		
+		case Instruction::ASR:
+			//AND #i
+			if(lazy_value) value = memory.ReadByte(address);
+			temp = registers.a & value;
+			SetNZ(temp & 0xFFu);
+			registers.a = temp & 0xFFu;
+			//LSR
+			value = registers.a;
+			temp = value >> 1u;
+			registers.p &= ~Flags::Carry;
+			if((value & 1u) != 0) registers.p |= (Flags::Carry);
+			SetNZ(temp & 0xFFu);
+			registers.a = temp & 0xFF;
+			break;
+		
+		case Instruction::ARR:
+			//AND #i
+			if(lazy_value) value = memory.ReadByte(address);
+			temp = registers.a & value;
+			SetNZ(temp & 0xFFu);
+			registers.a = temp & 0xFFu;
+			//ROR
+			value = registers.a;
+			temp = (value >> 1u) | ((registers.p & Flags::Carry) << 7u);
+			registers.p &= ~(Flags::Carry | Flags::Overflow);
+			
+			if((temp & bit6) != 0) registers.p |= Flags::Carry;
+			if(((temp & bit6) >> 1u) ^ (temp & bit5)) registers.p |= Flags::Overflow;
+			
+			SetNZ(temp & 0xFFu);
+			registers.a = temp & 0xFF;
+			break;
+			
+		case Instruction::AAC:
+			if(lazy_value) value = memory.ReadByte(address);
+			temp = registers.a & value;
+			registers.p &= ~Flags::Carry;
+			if(temp & 128u) registers.p |= Flags::Carry;
+			SetNZ(temp & 0xFFu);
+			registers.a = temp & 0xFFu;
+			break;
+
+		case Instruction::ASL:
+			if(lazy_value) value = memory.ReadByte(address);
+			temp = value << 1u;
+			registers.p &= ~Flags::Carry;
+			if((temp & 0x100u) != 0u) registers.p |= (Flags::Carry);
+			SetNZ(temp & 0xFFu);
+			//registers.a = temp & 0xFF;
+			goto PutValue;
+		
+		case Instruction::SLO:
+			//ASL
+			if(lazy_value) value = memory.ReadByte(address);
+			temp = value << 1u;
+			registers.p &= ~Flags::Carry;
+			if((temp & 0x100u) != 0u) registers.p |= (Flags::Carry);
+			SetNZ(temp & 0xFFu);
+			if(opCodes[opCode].addressing == Addressing::Accumulator) registers.a = temp & 0xFFu;
+			else memory.WriteByte(address, temp & 0xFFu);
+			//ORA
+			registers.a |= value;
+			SetNZ(registers.a);
+			break;
+			
+		case Instruction::BIT:
+			if(lazy_value) value = memory.ReadByte(address);
+			temp = registers.a & value;
+			SyncFlags();
+			registers.p &= ~(Flags::Zero | Flags::Sign | Flags::Overflow);
+			if((temp & 0xFFu) == 0) registers.p |= Flags::Zero;
+			if(value & Flags::Sign) registers.p |= Flags::Sign;
+			if(value & Flags::Overflow) registers.p |= Flags::Overflow;
+			break;
+
+		//Only branches, BIT, PHP, PLP, RTI and interrupts need N and Z in
+		//registers.p, so with LAZY_FLAGS they are materialised there
+		case Instruction::BPL:
+			SyncFlags();
+			if((registers.p & Flags::Sign) == 0) goto Branch;
+			break;
+
+		case Instruction::BMI:
+			SyncFlags();
+			if((registers.p & Flags::Sign) != 0) goto Branch;
+			break;
+
+		case Instruction::BVC:
+			if((registers.p & Flags::Overflow) == 0) goto Branch;
+			break;
+
+		case Instruction::BVS:
+			if((registers.p & Flags::Overflow) != 0) goto Branch;
+			break;
+
+		case Instruction::BCC:
+			if((registers.p & Flags::Carry) == 0) goto Branch;
+			break;
+
+		case Instruction::BCS:
+			if((registers.p & Flags::Carry) != 0) goto Branch;
+			break;
+
+		case Instruction::BNE:
+			SyncFlags();
+			if((registers.p & Flags::Zero) == 0) goto Branch;
+			break;
+
+		case Instruction::BEQ:
+			SyncFlags();
+			if((registers.p & Flags::Zero) != 0) goto Branch;
+			break;
+
+		Branch:
+			if(lazy_value) value = memory.ReadByte(address);
+			cycles += 1;											// +1 cycle for branches taken
+			if((value & 0x80u) == 0) temp = address + value;			// Handle positive offsets
+			else temp = address - (0x100u - value);					// Handle negative offsets
+			registers.pc = temp;
+			if((temp & 0xFF00u) != (address & 0xFF00u)) cycles += 1;		// Special page boundary penalty for branches
+			break;
+
+		case Instruction::BRK:
+			registers.pc++;
+			BRK();
+			break;
+
+		case Instruction::CMP:
+			temp = registers.a;
+			goto Compare;
+
+		case Instruction::CPX:
+			temp = registers.x;
+			goto Compare;
+
+		case Instruction::CPY:
+			temp = registers.y;
+			goto Compare;
+
+		Compare:
+			if(lazy_value) value = memory.ReadByte(address);
+			registers.p &= ~Flags::Carry;
+			if(temp >= value) registers.p |= Flags::Carry;
+			temp8 = temp & 0xFFu;
+			temp8 -= value;
+			SetNZ(temp8);
+			break;
+
+		case Instruction::DEC:
+			if(lazy_value) value = memory.ReadByte(address);
+			value -= 1u;
+			SetNZ(value);
+			memory.WriteByte(address, value);
+			break;
+
+		case Instruction::EOR:
+			if(lazy_value) value = memory.ReadByte(address);
+			temp = registers.a ^ value;
+			SetNZ(temp & 0xFFu);
+			registers.a = temp & 0xFFu;
+			break;
+
+		case Instruction::CLC:
+			registers.p &= ~Flags::Carry;
+			break;
+
+		case Instruction::SEC:
+			registers.p |= Flags::Carry;
+			break;
+
+		case Instruction::CLI:
+			registers.p &= ~Flags::Interrupt;
+			break;
+
+		case Instruction::SEI:
+			registers.p |= Flags::Interrupt;
+			break;
+
+		case Instruction::CLV:
+			registers.p &= ~Flags::Overflow;
+			break;
+
+		case Instruction::CLD:
+			registers.p &= ~Flags::Decimal;
+			break;
+
+		case Instruction::SED:
+			registers.p |= Flags::Decimal;
+			break;
+
+		case Instruction::INC:
+			if(lazy_value) value = memory.ReadByte(address);
+			value += 1u;
+			SetNZ(value);
+			memory.WriteByte(address, value);
+			break;
+
+		case Instruction::JMP:
+			registers.pc = address;
+			break;
+
+		case Instruction::JSR:
+			registers.pc--;
+			memory.WriteByte(0x0100u | (registers.s--), (registers.pc & 0xFF00u) >> 8u);
+			memory.WriteByte(0x0100u | (registers.s--), registers.pc & 0xFFu);
+			registers.pc = address;
+			break;
+
+		case Instruction::LDA:
+			if(lazy_value) value = memory.ReadByte(address);
+			registers.a = value;
+			SetNZ(registers.a);
+			break;
+
+		case Instruction::LDX:
+			if(lazy_value) value = memory.ReadByte(address);
+			registers.x = value;
+			SetNZ(registers.x);
+			break;
+
+		case Instruction::LDY:
+			if(lazy_value) value = memory.ReadByte(address);
+			registers.y = value;
+			SetNZ(registers.y);
+			break;
+
+		case Instruction::LSR:
+			if(lazy_value) value = memory.ReadByte(address);
+			temp = value >> 1u;
+			registers.p &= ~Flags::Carry;
+			if((value & 1u) != 0) registers.p |= (Flags::Carry);
+			SetNZ(temp & 0xFFu);
+			//registers.a = temp & 0xFF;
+			goto PutValue;
+		
+		case Instruction::DOP:
+		case Instruction::NOP:
+			if(lazy_value) value = memory.ReadByte(address);
+			break;
+
+		case Instruction::ORA:
+			if(lazy_value) value = memory.ReadByte(address);
+			registers.a |= value;
+			SetNZ(registers.a);
+			break;
+
+		case Instruction::TAX:
+			registers.x = registers.a;
+			SetNZ(registers.a);
+			break;
+
+		case Instruction::TXA:
+			registers.a = registers.x;
+			SetNZ(registers.a);
+			break;
+
+		case Instruction::TAY:
+			registers.y = registers.a;
+			SetNZ(registers.a);
+			break;
+
+		case Instruction::TYA:
+			registers.a = registers.y;
+			SetNZ(registers.a);
+			break;
+
+		case Instruction::INX:
+			registers.x++;
+			SetNZ(registers.x);
+			break;
+
+		case Instruction::DEX:
+			registers.x--;
+			SetNZ(registers.x);
+			break;
+
+		case Instruction::INY:
+			registers.y++;
+			SetNZ(registers.y);
+			break;
+
+		case Instruction::DEY:
+			registers.y--;
+			SetNZ(registers.y);
+			break;
+
+		case Instruction::ROL:
+			if(lazy_value) value = memory.ReadByte(address);
+			temp = (value << 1u) | (registers.p & Flags::Carry);
+			registers.p &= ~Flags::Carry;
+			if(value & 128u) registers.p |= Flags::Carry;
+			SetNZ(temp & 0xFFu);
+			//registers.a = temp & 0xFF;
+			goto PutValue;
+
+		case Instruction::ROR:
+			if(lazy_value) value = memory.ReadByte(address);
+			temp = (value >> 1u) | ((registers.p & Flags::Carry) << 7u);
+			registers.p &= ~Flags::Carry;
+			if((value & 1u) != 0) registers.p |= Flags::Carry;
+			SetNZ(temp & 0xFFu);
+			//registers.a = temp & 0xFF;
+			
+		PutValue:	// Used for ASL, LSR, ROL and ROR
+					// The only instructions for which the result can be stored
+					// either in memory or in the accumulator
+			if(opCodes[opCode].addressing == Addressing::Accumulator) registers.a = temp & 0xFFu;
+			else memory.WriteByte(address, temp & 0xFFu);
+			break;
+
+		case Instruction::RTI:
+			SyncFlags();
+			registers.p = memory.ReadByte(0x0100u | ((++registers.s) & 0xFFu));
+			registers.pc = memory.ReadByte(0x0100u | ((++registers.s) & 0xFFu));
+			registers.pc |= memory.ReadByte(0x0100u | ((++registers.s) & 0xFFu)) << 8u;
+			break;
+
+		case Instruction::RTS:
+			registers.pc = memory.ReadByte(0x0100u | ((++registers.s) & 0xFFu));
+			registers.pc |= memory.ReadByte(0x0100u | ((++registers.s) & 0xFFu)) << 8u;
+			registers.pc++;
+			break;
+
+		case Instruction::SBC:
+			if(lazy_value) value = memory.ReadByte(address);
+			temp = registers.a;
+			temp -= value + (!(registers.p & Flags::Carry));
+			registers.p &= ~(Flags::Carry | Flags::Overflow);
+			if(!(temp > 0xFFu)) registers.p |= Flags::Carry;
+			if((registers.a ^ temp) & (registers.a ^ value) & 0x80u) registers.p |= Flags::Overflow;
+			SetNZ(temp & 0xFFu);
+			registers.a = temp & 0xFFu;
+			break;
+
+		case Instruction::STA:
+			memory.WriteByte(address, registers.a);
+			break;
+
+		case Instruction::STX:
+			memory.WriteByte(address, registers.x);
+			break;
+
+		case Instruction::STY:
+			memory.WriteByte(address, registers.y);
+			break;
+
+		case Instruction::TXS:
+			registers.s = registers.x;
+			break;
+
+		case Instruction::TSX:
+			registers.x = registers.s;
+			SetNZ(registers.x);
+			break;
+
+		case Instruction::PHA:
+			memory.WriteByte(0x0100u | (registers.s--), registers.a);
+			break;
+
+		case Instruction::PLA:
+			registers.a = memory.ReadByte(0x0100u | ((++registers.s) & 0xFFu));
+			SetNZ(registers.a);
+			break;
+
+		case Instruction::PHP:
+			SyncFlags();
+			memory.WriteByte(0x0100u | (registers.s--), registers.p | bit4 | bit5);
+			break;
+
+		case Instruction::PLP:
+			SyncFlags();
+			registers.p = memory.ReadByte(0x0100u | ((++registers.s) & 0xFFu));
+			break;
+
+		case Instruction::Unknown:
+			fprintf(stderr, "%04X:\tUnknown instruction: %02X\n", registers.pc, opCode);
+			abort();
+			break;
+		
+		case Instruction::RLA:
+		case Instruction::SRE:		
+		case Instruction::RRA:		
+		case Instruction::AAX:		
+		case Instruction::LAX:
+		case Instruction::DCP:		
+		case Instruction::ISC:
+		case Instruction::TOP:
+		case Instruction::SYA:
+		case Instruction::SXA:
+			//I lost the patience to implement this crap
+			break;
+	}
+	
+	return cycles;
+}
+
+template<class MemoryType>
+void MachineT<MemoryType>::Interrupt(uint16_t vec_addr, bool push, bool setB)
+{
+	SyncFlags();
+	if(push){
+		memory.WriteByte(0x0100u | (registers.s--), (registers.pc & 0xFF00u) >> 8u);
+		memory.WriteByte(0x0100u | (registers.s--), registers.pc & 0xFFu);
+		memory.WriteByte(0x0100u | (registers.s--), registers.p | (setB ? (Flags::Break | 0x20) : 0));
+	}
+	uint16_t hi = memory.ReadByte(vec_addr + 1u);
+	uint16_t lo = memory.ReadByte(vec_addr);
+	registers.pc =  lo | (hi << 8u);
+}
+
+template<class MemoryType>
+void MachineT<MemoryType>::NMI()
+{
+	Interrupt(0xFFFA, true, false);
+	registers.p |= Flags::Interrupt;
+}
+
+template<class MemoryType>
+void MachineT<MemoryType>::Reset()
+{
+	Interrupt(0xFFFC, false, false);
+	registers.s -= 0x3u;
+}
+
+template<class MemoryType>
+void MachineT<MemoryType>::IRQ()
+{
+	if(registers.p & Flags::Interrupt) return;
+	Interrupt(0xFFFE, true, false);
+	registers.p |= Flags::Interrupt;
+}
+
+template<class MemoryType>
+void MachineT<MemoryType>::BRK()
+{
+	Interrupt(0xFFFE, true, true);
+	registers.p |= Flags::Interrupt;
+}
+
+template<class MemoryType>
+void MachineT<MemoryType>::Savestate(FILE *f)
+{
+	SyncFlags();
+	fputc(registers.a, f);
+	fputc(registers.x, f);
+	fputc(registers.y, f);
+	fputc(registers.p, f);
+	fputc(registers.s, f);
+	fwrite(&registers.pc, 2, 1, f);
+}
+
+template<class MemoryType>
+void MachineT<MemoryType>::Loadstate(FILE *f)
+{
+	SyncFlags();
+	registers.a = fgetc(f);
+	registers.x = fgetc(f);
+	registers.y = fgetc(f);
+	registers.p = fgetc(f);
+	registers.s = fgetc(f);
+	fread(&registers.pc, 2, 1, f);
+}
+
+#endif
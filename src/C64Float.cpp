@@ -1,52 +1,206 @@
 #include "C64Float.h"
 #include "C64Memory.h"
+#include "C64Translated.h"
+#include "C64Hooks.h"
+#include "C64Math.h"
 
 #include <unordered_map>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <atomic>
 #include <csignal>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
 
-static unsigned long long cycles = 0;
+//Cycles run by each thread, in slots that GetCycles() adds up. Slots are
+//never taken off the list: a thread that exits leaves its slot, count
+//and all, to the next thread started, so the sum stays the total run.
+//Only atomics, so it needs no threads library in builds without one.
+class CycleCounter
+{
+	struct Slot
+	{
+		std::atomic<unsigned long long> count{0};
+		std::atomic<bool> taken{true};
+		Slot *next = nullptr;
+	};
+	static std::atomic<Slot *> slots;
+	
+	Slot *slot;
+	unsigned long long base;	//What the slot held when this thread took it
+	
+	public:
+	CycleCounter()
+	{
+		for(slot = slots.load(std::memory_order_acquire); slot; slot = slot->next){
+			bool expected = false;
+			if(slot->taken.compare_exchange_strong(expected, true, std::memory_order_acquire)) break;
+		}
+		if(!slot){
+			slot = new Slot;
+			slot->next = slots.load(std::memory_order_relaxed);
+			while(!slots.compare_exchange_weak(slot->next, slot, std::memory_order_release, std::memory_order_relaxed));
+		}
+		base = slot->count.load(std::memory_order_relaxed);
+	}
+	
+	~CycleCounter()
+	{
+		slot->taken.store(false, std::memory_order_release);
+	}
+	
+	CycleCounter(const CycleCounter &) = delete;
+	CycleCounter &operator=(const CycleCounter &) = delete;
+	
+	//Only this thread writes the slot, so no read-modify-write is needed
+	void add(unsigned long long n)
+	{
+		slot->count.store(slot->count.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+	}
+	
+	unsigned long long thread() const
+	{
+		return slot->count.load(std::memory_order_relaxed) - base;
+	}
+	
+	static unsigned long long total()
+	{
+		unsigned long long sum = 0;
+		for(Slot *s = slots.load(std::memory_order_acquire); s; s = s->next){
+			sum += s->count.load(std::memory_order_relaxed);
+		}
+		return sum;
+	}
+};
+
+std::atomic<CycleCounter::Slot *> CycleCounter::slots{nullptr};
+
+static CycleCounter &Counter()
+{
+	static thread_local CycleCounter counter;
+	return counter;
+}
 
-C64Float C64Float::zero("0.0"), C64Float::unit("1.0");
+bool C64Float::native = false;
+bool C64Float::legacyConversion = false;
 
 class C64Prog
 {
 	public:
 	C64Memory mem;
-	Machine cpu;
+	C64Machine cpu;
 	uint8_t *ram;
 	uint8_t *prg;
 	uint8_t *start;
 	
-	C64Prog getAddr(size_t &addr)
+	//Programs and their data go in $C000-$CFFF, each after the last. The
+	//bytes of one that does not fit are not written, and close() then
+	//gives its space back, as it does for one with a branch that cannot
+	//reach its label.
+	static const size_t AreaStart = 0xC000;
+	static const size_t AreaEnd = 0xD000;
+	uint8_t *top;			//First byte not yet handed out
+	bool failed;
+	
+	//The programs each emulated operation runs, assembled once into the
+	//context by the constructor
+	enum Stub
+	{
+		STUB_FIN,
+		STUB_FOUT,
+		STUB_FMUL,
+		STUB_FADD,
+		STUB_FSUB,
+		STUB_FDIV,
+		STUB_SQR,
+		STUB_ATN,
+		STUB_COS,
+		STUB_EXP,
+		STUB_PWR,
+		STUB_SIN,
+		STUB_TAN,
+		STUB_LOG,
+		STUB_COUNT
+	};
+	
+	//Where the stubs take their operands from and leave the result in FAC.
+	//They are where the programs built on each call used to put them, and
+	//the text starts a page as it did, so GetCycles() counts the same.
+	static const size_t SlotFAC = 0xC000;
+	static const size_t SlotARG = 0xC005;
+	static const size_t TextSize = 0x400;
+	size_t slotText;
+	
+	struct Program
+	{
+		uint8_t *start, *end;
+	};
+	Program stubs[STUB_COUNT];
+	
+	//Programs for whole expressions, assembled by Fuse when first run and
+	//kept by their postfix text. They take what is left of the area.
+	struct Fused
+	{
+		Program program;
+		size_t leaves, result;	//First leaf slot, result slot
+	};
+	std::unordered_map<std::string, Fused> fused;
+	
+	//Loops running a routine over a block of elements in the BASIC
+	//program area, which the ROM routines leave alone: MOVFM, the routine
+	//with the ARG operand if binary, and MOVMF over the element. They keep
+	//pointers to the element in the zero page bytes the ROM leaves free,
+	//and stop when the last one stepped reaches the end. routine, endLow
+	//and endHigh are the JSR and CMPs patched before a run.
+	struct Batch
+	{
+		Program program;
+		size_t routine, endLow, endHigh;
+	};
+	Batch batches[2];		//Unary, binary
+	static const size_t BatchArea = 0x0800;
+	static const size_t BatchEnd = 0xA000;
+	static const uint8_t BatchFAC = 0xFB;
+	static const uint8_t BatchARG = 0xFD;
+	
+	//A place in a program for branches to go to, placed with label()
+	//before or after them. Those ahead of it wait in pending.
+	struct Label
+	{
+		size_t addr = 0;
+		std::vector<size_t> pending;
+	};
+	
+	C64Prog &getAddr(size_t &addr)
 	{
 		addr = prg - ram;
 		return *this;
 	}
 	
-	C64Prog pushBytes(uint8_t b1)
+	C64Prog &pushBytes(uint8_t b1)
 	{
+		if(prg >= ram + AreaEnd){
+			failed = true;
+			prg++;
+			return *this;
+		}
 		*(prg++) = b1;
 		return *this;
 	}
 	
-	C64Prog pushBytes(uint8_t b1, uint8_t b2)
+	C64Prog &pushBytes(uint8_t b1, uint8_t b2)
 	{
-		*(prg++) = b1;
-		*(prg++) = b2;
-		return *this;
+		return pushBytes(b1).pushBytes(b2);
 	}
 	
-	C64Prog pushBytes(uint8_t b1, uint8_t b2, uint8_t b3)
+	C64Prog &pushBytes(uint8_t b1, uint8_t b2, uint8_t b3)
 	{
-		*(prg++) = b1;
-		*(prg++) = b2;
-		*(prg++) = b3;
-		return *this;
+		return pushBytes(b1).pushBytes(b2).pushBytes(b3);
 	}
 	
-	C64Prog reserve(size_t n)
+	C64Prog &reserve(size_t n)
 	{
 		for(size_t i = 0; i < n; i++){
 			pushBytes(0);
@@ -54,7 +208,71 @@ class C64Prog
 		return *this;
 	}
 	
-	C64Prog pushFloat(const C64Float f)
+	//Starts a program at the first free byte of the area
+	C64Prog &open()
+	{
+		prg = top;
+		failed = false;
+		return begin();
+	}
+	
+	//Reserves n bytes, starting at a multiple of align
+	C64Prog &allocate(size_t &addr, size_t n, size_t align = 1)
+	{
+		while((prg - ram) % align) pushBytes(0);
+		return getAddr(addr).reserve(n);
+	}
+	
+	//Keeps what was pushed since open(), or false if it did not fit or a
+	//branch could not reach
+	bool close()
+	{
+		if(failed){
+			prg = top;
+			return false;
+		}
+		top = prg;
+		return true;
+	}
+	
+	//Sets the offset byte of the branch at at. One that cannot reach fails
+	//the program, for close() to report.
+	void patchBranch(size_t at, size_t to)
+	{
+		if(at >= AreaEnd) return;
+		long offset = (long) to - (long) (at + 1);
+		if(offset < -128 || offset > 127){
+			failed = true;
+			return;
+		}
+		ram[at] = (uint8_t) offset;
+	}
+	
+	C64Prog &label(Label &l)
+	{
+		getAddr(l.addr);
+		for(size_t at : l.pending) patchBranch(at, l.addr);
+		l.pending.clear();
+		return *this;
+	}
+	
+	C64Prog &pushBranch(uint8_t op, Label &l)
+	{
+		size_t at;
+		pushBytes(op).getAddr(at).pushBytes(0);
+		if(l.addr) patchBranch(at, l.addr);
+		else l.pending.push_back(at);
+		return *this;
+	}
+	
+	//Adds n to the 16 bit value at addr, leaving its low byte in A
+	C64Prog &pushAdd16(size_t addr, uint8_t n)
+	{
+		Label done;
+		return pushLDAAbs(addr).pushCLC().pushADC(n).pushSTA(addr).pushBCC(done).pushINC(addr + 1).label(done);
+	}
+	
+	C64Prog &pushFloat(const C64Float f)
 	{
 		for(size_t i = 0; i < sizeof(f.val); i++){
 			pushBytes(f.val[i]);
@@ -62,7 +280,7 @@ class C64Prog
 		return *this;
 	}
 	
-	C64Prog pushString(const char *str)
+	C64Prog &pushString(const char *str)
 	{
 		do{
 			pushBytes(*str);
@@ -70,56 +288,106 @@ class C64Prog
 		return *this;
 	}
 	
-	C64Prog pushLDA(uint8_t val){    return pushBytes(0xA9, val); }                                                      //LDA immediate
-	C64Prog pushLDY(uint8_t val){    return pushBytes(0xA0, val); }                                                      //LDY immediate
-	C64Prog pushLDX(uint8_t val){    return pushBytes(0xA2, val); }                                                      //LDX immediate
-	C64Prog pushJSR(size_t addr){    return pushBytes(0x20, addr & 0xFFu, addr >> 8u); }                                 //JSR addr
-	C64Prog pushAddrAY(size_t addr){ return pushLDA(addr & 0xFFu).pushLDY(addr >> 8u); }                                 //LDA #<addr LDY #>addr
-	C64Prog pushAddrXY(size_t addr){ return pushLDX(addr & 0xFFu).pushLDY(addr >> 8u); }                                 //LDX #<addr LDY #>addr
-	C64Prog pushSTA(size_t addr){                                                                                        //
+	C64Prog &pushLDA(uint8_t val){    return pushBytes(0xA9, val); }                                                     //LDA immediate
+	C64Prog &pushLDY(uint8_t val){    return pushBytes(0xA0, val); }                                                     //LDY immediate
+	C64Prog &pushLDX(uint8_t val){    return pushBytes(0xA2, val); }                                                     //LDX immediate
+	C64Prog &pushJSR(size_t addr){    return pushBytes(0x20, addr & 0xFFu, addr >> 8u); }                                //JSR addr
+	C64Prog &pushAddrAY(size_t addr){ return pushLDA(addr & 0xFFu).pushLDY(addr >> 8u); }                                //LDA #<addr LDY #>addr
+	C64Prog &pushAddrXY(size_t addr){ return pushLDX(addr & 0xFFu).pushLDY(addr >> 8u); }                                //LDX #<addr LDY #>addr
+	C64Prog &pushSTA(size_t addr){                                                                                       //
 		if(addr >= 0x100)                                                                                                //
 			                         return pushBytes(0x8D, addr & 0xFFu, addr >> 8u);                                   //STA $addr
 		else                                                                                                             //
 			                         return pushBytes(0x85, addr);                                                       //STA $addr (zero-page)
 	}                                                                                                                    //
-	C64Prog pushSTY(size_t addr){                                                                                        //
+	C64Prog &pushSTY(size_t addr){                                                                                       //
 		if(addr >= 0x100)                                                                                                //
 			                         return pushBytes(0x8C, addr & 0xFFu, addr >> 8u);                                   //STY $addr
 		else                                                                                                             //
 			                         return pushBytes(0x84, addr);                                                       //STY $addr (zero-page)
 	}                                                                                                                    //
-	C64Prog pushMOVFM(size_t addr){  return pushAddrAY(addr).pushJSR(0xBBA2); }                                          //Fetch a number from a RAM location to FAC (A=Addr.LB, Y=Addr.HB) 
-	C64Prog pushCONUPK(size_t addr){ return pushAddrAY(addr).pushJSR(0xBA8C); }                                          //Fetch a number from a RAM location to ARG (A=Addr.LB, Y=Addr.HB) 
-	C64Prog pushMOVMF(size_t addr){  return pushAddrXY(addr).pushJSR(0xBBD4); }                                          //
+	C64Prog &pushLDAAbs(size_t addr){                                                                                    //
+		if(addr >= 0x100)                                                                                                //
+			                         return pushBytes(0xAD, addr & 0xFFu, addr >> 8u);                                   //LDA $addr
+		else                                                                                                             //
+			                         return pushBytes(0xA5, addr);                                                       //LDA $addr (zero-page)
+	}                                                                                                                    //
+	C64Prog &pushLDAAbsX(size_t addr){ return pushBytes(0xBD, addr & 0xFFu, addr >> 8u); }                               //LDA $addr,X
+	C64Prog &pushLDAAbsY(size_t addr){ return pushBytes(0xB9, addr & 0xFFu, addr >> 8u); }                               //LDA $addr,Y
+	C64Prog &pushLDAIndY(uint8_t zp){ return pushBytes(0xB1, zp); }                                                      //LDA ($zp),Y
+	C64Prog &pushSTAAbsX(size_t addr){ return pushBytes(0x9D, addr & 0xFFu, addr >> 8u); }                               //STA $addr,X
+	C64Prog &pushSTAAbsY(size_t addr){ return pushBytes(0x99, addr & 0xFFu, addr >> 8u); }                               //STA $addr,Y
+	C64Prog &pushSTAIndY(uint8_t zp){ return pushBytes(0x91, zp); }                                                      //STA ($zp),Y
+	C64Prog &pushPtrAY(uint8_t zp){   return pushBytes(0xA5, zp).pushBytes(0xA4, zp + 1u); }                             //LDA $zp LDY $zp+1
+	C64Prog &pushPtrXY(uint8_t zp){   return pushBytes(0xA6, zp).pushBytes(0xA4, zp + 1u); }                             //LDX $zp LDY $zp+1
+	C64Prog &pushINC(size_t addr){                                                                                       //
+		if(addr >= 0x100)                                                                                                //
+			                         return pushBytes(0xEE, addr & 0xFFu, addr >> 8u);                                   //INC $addr
+		else                                                                                                             //
+			                         return pushBytes(0xE6, addr);                                                       //INC $addr (zero-page)
+	}                                                                                                                    //
+	C64Prog &pushINX(){               return pushBytes(0xE8); }                                                          //INX
+	C64Prog &pushINY(){               return pushBytes(0xC8); }                                                          //INY
+	C64Prog &pushDEX(){               return pushBytes(0xCA); }                                                          //DEX
+	C64Prog &pushDEY(){               return pushBytes(0x88); }                                                          //DEY
+	C64Prog &pushCLC(){               return pushBytes(0x18); }                                                          //CLC
+	C64Prog &pushADC(uint8_t val){    return pushBytes(0x69, val); }                                                     //ADC immediate
+	C64Prog &pushCMP(uint8_t val){    return pushBytes(0xC9, val); }                                                     //CMP immediate
+	C64Prog &pushCPX(uint8_t val){    return pushBytes(0xE0, val); }                                                     //CPX immediate
+	C64Prog &pushCPY(uint8_t val){    return pushBytes(0xC0, val); }                                                     //CPY immediate
+	C64Prog &pushBNE(Label &l){       return pushBranch(0xD0, l); }                                                      //BNE label
+	C64Prog &pushBEQ(Label &l){       return pushBranch(0xF0, l); }                                                      //BEQ label
+	C64Prog &pushBCC(Label &l){       return pushBranch(0x90, l); }                                                      //BCC label
+	C64Prog &pushBCS(Label &l){       return pushBranch(0xB0, l); }                                                      //BCS label
+	C64Prog &pushBPL(Label &l){       return pushBranch(0x10, l); }                                                      //BPL label
+	C64Prog &pushBMI(Label &l){       return pushBranch(0x30, l); }                                                      //BMI label
+	C64Prog &pushMOVFM(size_t addr){  return pushAddrAY(addr).pushJSR(0xBBA2); }                                         //Fetch a number from a RAM location to FAC (A=Addr.LB, Y=Addr.HB) 
+	C64Prog &pushCONUPK(size_t addr){ return pushAddrAY(addr).pushJSR(0xBA8C); }                                         //Fetch a number from a RAM location to ARG (A=Addr.LB, Y=Addr.HB) 
+	C64Prog &pushMOVMF(size_t addr){  return pushAddrXY(addr).pushJSR(0xBBD4); }                                         //
 	                                                                                                                     //Store the number currently in FAC, to a RAM location. Uses X and Y rather than A and Y to point to RAM. (X=Addr.LB, Y=Addr.HB)
-	C64Prog pushMOVEF(){             return pushJSR(0xBBFC); }                                                           //Copy a number currently in ARG, over into FAC 
-	C64Prog pushMOVFA(size_t addr){  return pushJSR(0xBC0F); }                                                           //Copy a number currently in FAC, over into ARG 
-	C64Prog pushCHRGET(){            return pushJSR(0x0079); }                                                           //CHRGET routine: fetches next character of BASIC program text 
-	C64Prog pushFADD(size_t addr){   return pushAddrAY(addr).pushJSR(0xB867); }                                          //Adds the number in FAC with one stored in RAM (A=Addr.LB, Y=Addr.HB) 
-	C64Prog pushFSUB(size_t addr){   return pushAddrAY(addr).pushJSR(0xB850); }                                          //Subtracts the number in FAC from one stored in RAM (A=Addr.LB, Y=Addr.HB) 
-	C64Prog pushFDIV(size_t addr){   return pushAddrAY(addr).pushJSR(0xBB0F); }                                          //Divides a number stored in RAM by the number in FAC (A=Addr.LB, Y=Addr.HB) 
-	C64Prog pushFMUL(size_t addr){   return pushAddrAY(addr).pushJSR(0xBA28); }                                          //Multiplication with memory contents pointed to by A/Y (low/high).
-	C64Prog pushSQR(){               return pushJSR(0xBF71); }                                                           //Performs the SQR function on the number in FAC 
-	C64Prog pushABS(){               return pushJSR(0xBC58); }                                                           //Performs the ABS function on the number in FAC 
-	C64Prog pushFIN(size_t addr){    return pushAddrAY(addr).pushSTA(0x7A).pushSTY(0x7B).pushCHRGET().pushJSR(0xBCF3); } //
+	C64Prog &pushMOVEF(){             return pushJSR(0xBBFC); }                                                          //Copy a number currently in ARG, over into FAC 
+	C64Prog &pushMOVFA(size_t addr){  return pushJSR(0xBC0F); }                                                          //Copy a number currently in FAC, over into ARG 
+	C64Prog &pushCHRGET(){            return pushJSR(0x0079); }                                                          //CHRGET routine: fetches next character of BASIC program text 
+	C64Prog &pushFADD(size_t addr){   return pushAddrAY(addr).pushJSR(0xB867); }                                         //Adds the number in FAC with one stored in RAM (A=Addr.LB, Y=Addr.HB) 
+	C64Prog &pushFSUB(size_t addr){   return pushAddrAY(addr).pushJSR(0xB850); }                                         //Subtracts the number in FAC from one stored in RAM (A=Addr.LB, Y=Addr.HB) 
+	C64Prog &pushFDIV(size_t addr){   return pushAddrAY(addr).pushJSR(0xBB0F); }                                         //Divides a number stored in RAM by the number in FAC (A=Addr.LB, Y=Addr.HB) 
+	C64Prog &pushFMUL(size_t addr){   return pushAddrAY(addr).pushJSR(0xBA28); }                                         //Multiplication with memory contents pointed to by A/Y (low/high).
+	C64Prog &pushSQR(){               return pushJSR(0xBF71); }                                                          //Performs the SQR function on the number in FAC 
+	C64Prog &pushABS(){               return pushJSR(0xBC58); }                                                          //Performs the ABS function on the number in FAC 
+	C64Prog &pushFIN(size_t addr){    return pushAddrAY(addr).pushSTA(0x7A).pushSTY(0x7B).pushCHRGET().pushJSR(0xBCF3); } //
 	                                                                                                                     //Convert number expressed as a zero-terminated PETSCII string, to floating point number in FAC. Expects string-address in $7a/$7b, and to make it work either call CHRGOT ($0079) beforehand or load the accumulator with the first char of the string and clear the carry-flag manually. 
-	C64Prog pushFOUT(){              return pushJSR(0xBDDD); }                                                           //
+	C64Prog &pushFOUT(){              return pushJSR(0xBDDD); }                                                          //
 	                                                                                                                     //Convert number in FAC to a zero-terminated PETSCII string (starting at $0100, address in A, Y too). Direct output of FAC also via $AABC/43708 possible. 
-	C64Prog pushFCOMP(size_t addr){  return pushAddrAY(addr).pushJSR(0xBC5B); }                                          //
+	C64Prog &pushFCOMP(size_t addr){  return pushAddrAY(addr).pushJSR(0xBC5B); }                                         //
 	                                                                                                                     //Compares the number in FAC against one stored in RAM (A=Addr.LB, Y=Addr.HB). The result of the comparison is stored in A: Zero (0) indicates the values were equal. One (1) indicates FAC was greater than RAM and negative one (-1 or $FF) indicates FAC was less than RAM. Also sets processor flags (N,Z) depending on whether the number in FAC is zero, positive or negative
-	C64Prog pushATN(){               return pushJSR(0xE30E); }                                                           //Performs the ATN function on the number in FAC 
-	C64Prog pushCOS(){               return pushJSR(0xE264); }                                                           //Performs the COS function on the number in FAC 
-	C64Prog pushEXP(){               return pushJSR(0xBFED); }                                                           //Performs the EXP function on the number in FAC 
-	C64Prog pushPWR(size_t addr){    return pushAddrAY(addr).pushJSR(0xBF78); }                                          //Raises a number stored ín RAM to the power in FAC (A=Addr.LB, Y=Addr.HB)
-	C64Prog pushPWR_(){              return pushJSR(0xBF7B); }                                                           //FAC2 raised to the power of FAC1 (FAC2^FAC1). 
+	C64Prog &pushATN(){               return pushJSR(0xE30E); }                                                          //Performs the ATN function on the number in FAC 
+	C64Prog &pushCOS(){               return pushJSR(0xE264); }                                                          //Performs the COS function on the number in FAC 
+	C64Prog &pushEXP(){               return pushJSR(0xBFED); }                                                          //Performs the EXP function on the number in FAC 
+	C64Prog &pushPWR(size_t addr){    return pushAddrAY(addr).pushJSR(0xBF78); }                                         //Raises a number stored ín RAM to the power in FAC (A=Addr.LB, Y=Addr.HB)
+	C64Prog &pushPWR_(){              return pushJSR(0xBF7B); }                                                          //FAC2 raised to the power of FAC1 (FAC2^FAC1). 
 																														 //This routine uses the formula exp(x*log(y)) to calculate yx, so it calculates two series (log and exp). It is slow and not entirely accurate. For whole number powers, it is often quicker and more accurate to use a series of multiplies. 
-	C64Prog pushLOG(){               return pushJSR(0xB9EA); }                                                           //Performs the LOG function on the number in FAC 
-	C64Prog pushSIN(){               return pushJSR(0xE26B); }                                                           //Performs the SIN function on the number in FAC 
-	C64Prog pushTAN(){               return pushJSR(0xE2B4); }                                                           //Performs the TAN function on the number in FAC 
-	C64Prog pushINT(){               return pushJSR(0xBCCC); }                                                           //Performs the INT function on the number in FAC 
-	C64Prog pushQINT(){              return pushJSR(0xBC9B); }                                                           //Convert number in FAC to 32-bit signed integer ($62-$65, big-endian order).
+	C64Prog &pushLOG(){               return pushJSR(0xB9EA); }                                                          //Performs the LOG function on the number in FAC 
+	C64Prog &pushSIN(){               return pushJSR(0xE26B); }                                                          //Performs the SIN function on the number in FAC 
+	C64Prog &pushTAN(){               return pushJSR(0xE2B4); }                                                          //Performs the TAN function on the number in FAC 
+	C64Prog &pushINT(){               return pushJSR(0xBCCC); }                                                          //Performs the INT function on the number in FAC 
+	C64Prog &pushQINT(){              return pushJSR(0xBC9B); }                                                          //Convert number in FAC to 32-bit signed integer ($62-$65, big-endian order).
+	
+	C64Prog &setFloat(size_t addr, const C64Float f)
+	{
+		std::memcpy(ram + addr, f.val, sizeof(f.val));
+		return *this;
+	}
 	
-	C64Prog popFloat(size_t addr, C64Float &f)
+	//The text for FIN, cut short to fit
+	C64Prog &setText(const char *str)
+	{
+		size_t length = std::min(std::strlen(str), TextSize - 1);
+		std::memcpy(ram + slotText, str, length);
+		ram[slotText + length] = 0;
+		return *this;
+	}
+	
+	C64Prog &popFloat(size_t addr, C64Float &f)
 	{
 		for(size_t i = 0; i < sizeof(f.val); i++){
 			f.val[i] = ram[addr + i];
@@ -157,7 +425,7 @@ class C64Prog
 		return a;
 	}
 	
-	C64Prog popString(size_t addr, char *out)
+	C64Prog &popString(size_t addr, char *out)
 	{
 		uint8_t *str = ram + addr;
 		do{
@@ -166,45 +434,194 @@ class C64Prog
 		return *this;
 	}
 	
-	C64Prog begin()
+	C64Prog &begin()
 	{
 		start = prg;
 		return *this;
 	}
 	
-	C64Prog execute()
+	C64Prog &assemble(Batch &batch, bool binary)
+	{
+		Label loop;
+		uint8_t last = binary ? BatchARG : BatchFAC;
+		begin().label(loop);
+		pushPtrAY(BatchFAC).pushJSR(0xBBA2);
+		if(binary) pushPtrAY(BatchARG);
+		getAddr(batch.routine).pushJSR(0);
+		pushPtrXY(BatchFAC).pushJSR(0xBBD4);
+		pushAdd16(BatchFAC, 5);
+		if(binary) pushAdd16(BatchARG, 5);
+		getAddr(batch.endLow).pushCMP(0).pushBNE(loop);
+		pushLDAAbs(last + 1u);
+		getAddr(batch.endHigh).pushCMP(0).pushBNE(loop);
+		batch.program.start = start;
+		batch.program.end = prg;
+		return *this;
+	}
+	
+	//Points a batch loop at the routine and the end of its block
+	C64Prog &patch(const Batch &batch, uint16_t routine, size_t end)
+	{
+		ram[batch.routine + 1] = routine & 0xFFu;
+		ram[batch.routine + 2] = routine >> 8u;
+		ram[batch.endLow + 1] = end & 0xFFu;
+		ram[batch.endHigh + 1] = end >> 8u;
+		return *this;
+	}
+	
+	//Marks what was pushed since begin() as the stub
+	C64Prog &keep(Stub stub)
+	{
+		stubs[stub].start = start;
+		stubs[stub].end = prg;
+		return *this;
+	}
+	
+	//Makes the stub the program execute() runs
+	C64Prog &load(Stub stub)
+	{
+		return load(stubs[stub]);
+	}
+	
+	C64Prog &load(const Program &program)
+	{
+		start = program.start;
+		prg = program.end;
+		return *this;
+	}
+	
+	//No routine comes anywhere near this, a program running for longer
+	//has gone astray
+	static const unsigned long long MaxCycles = 100000000ull;
+	
+	//Cycles taken by the last run, and of those, the ones before it last
+	//reached its mark. Left for the caller to count, as a run that fails
+	//may be done again some other way.
+	unsigned long long used, marked;
+	
+	//Runs the program, false if it ended up in the error handler. A batch
+	//loop gets the limit once per element, and marks its first instruction.
+	bool run(unsigned long long limit = MaxCycles, uint16_t mark = 0)
 	{
 		//Avoid return addresses being overwritten by string
 		cpu.registers.s = 0xFF;
 		
 		cpu.registers.pc = start - ram;
-		size_t end = prg - ram;
+		uint16_t end = prg - ram;
+		cpu.SetStop(end);
+		if(mark) cpu.SetStop(mark);
 		
+		used = marked = 0;
 		while(
 			cpu.registers.pc != end &&
 			cpu.registers.pc != 0xFF48
 		){
-			cycles += cpu.DoStep();
+			if(used >= limit){
+				fprintf(stderr, "%04X:\tProgram did not finish in %llu cycles\n", cpu.registers.pc, used);
+				abort();
+			}
+			
+			if(mark && cpu.registers.pc == mark){
+				marked = used;
+				used += cpu.DoStep();
+				continue;
+			}
+			
+			//Translated ROM code is skipped while tracing, as it writes no log.
+			//It runs until it leaves the translated routines, so HLE hooks
+			//are not called on the way, limit is only checked once it has
+			//returned, and stops set here are not seen. end and mark are in
+			//RAM, and romgen leaves the ROM stops untranslated.
+			if(IsTranslatedROM(cpu.registers.pc)){
+				if(!cpu.log_file && mem.basicIn && mem.kernalIn){
+					cpu.SyncFlags();
+					used += RunTranslatedROM(cpu);
+				}
+				else{
+					used += cpu.DoStep();
+				}
+				continue;
+			}
+			
+			used += cpu.Run(limit - used).cycles;
 		}
+		cpu.ClearStop(end);
+		if(mark) cpu.ClearStop(mark);
+		cpu.SyncFlags();
 		
-		if(cpu.registers.pc == 0xFF48){
+		return cpu.registers.pc != 0xFF48;
+	}
+	
+	C64Prog &execute()
+	{
+		bool ok = run();
+		Counter().add(used);
+		if(!ok){
 			std::raise(SIGFPE);
 		}
-		
 		return *this;
 	}
 	
+	//Returns the machine to the state of a freshly constructed C64Prog.
+	//Only the zero page, the stack page and the operand slots are touched
+	//by the stubs and the ROM routines they call. The first two are
+	//cleared instead of rebuilding the whole 64 KB image, the slots are
+	//all written before a stub runs.
+	void reset()
+	{
+		std::memset(ram, 0, 0x200);
+		mem.CopyCHRGET();
+		cpu.registers = C64Machine::Registers{};
+	}
+	
 	C64Prog() :
 		mem(),
 		cpu(mem),
 		ram(mem.ram),
 		prg(ram + 0xC000)
 	{
+		//Run hands back control at the error handler and wherever the
+		//translated ROM code can take over
+		cpu.SetStop(0xFF48);
+		for(unsigned int pc = 0xA000; pc <= 0xFFFF; pc++){
+			if(IsTranslatedROM(pc)) cpu.SetStop(pc);
+		}
+		
+		#if defined(HLE_VERIFY)
+		InstallHooks(cpu, true);
+		#elif defined(HLE_HOOKS)
+		InstallHooks(cpu, false);
+		#endif
+		
+		top = ram + SlotARG + 5;
+		open().allocate(slotText, TextSize, 0x100);
+		begin().pushFIN(slotText).pushMOVMF(SlotFAC).keep(STUB_FIN);
+		begin().pushMOVFM(SlotFAC).pushFOUT().keep(STUB_FOUT);
+		begin().pushMOVFM(SlotFAC).pushFMUL(SlotARG).pushMOVMF(SlotFAC).keep(STUB_FMUL);
+		begin().pushMOVFM(SlotFAC).pushFADD(SlotARG).pushMOVMF(SlotFAC).keep(STUB_FADD);
+		begin().pushMOVFM(SlotFAC).pushFSUB(SlotARG).pushMOVMF(SlotFAC).keep(STUB_FSUB);
+		begin().pushMOVFM(SlotFAC).pushFDIV(SlotARG).pushMOVMF(SlotFAC).keep(STUB_FDIV);
+		begin().pushMOVFM(SlotFAC).pushSQR().pushMOVMF(SlotFAC).keep(STUB_SQR);
+		begin().pushMOVFM(SlotFAC).pushATN().pushMOVMF(SlotFAC).keep(STUB_ATN);
+		begin().pushMOVFM(SlotFAC).pushCOS().pushMOVMF(SlotFAC).keep(STUB_COS);
+		begin().pushMOVFM(SlotFAC).pushEXP().pushMOVMF(SlotFAC).keep(STUB_EXP);
+		begin().pushMOVFM(SlotFAC).pushCONUPK(SlotARG).pushPWR_().pushMOVMF(SlotFAC).keep(STUB_PWR);
+		begin().pushMOVFM(SlotFAC).pushSIN().pushMOVMF(SlotFAC).keep(STUB_SIN);
+		begin().pushMOVFM(SlotFAC).pushTAN().pushMOVMF(SlotFAC).keep(STUB_TAN);
+		begin().pushMOVFM(SlotFAC).pushLOG().pushMOVMF(SlotFAC).keep(STUB_LOG);
+		assemble(batches[0], false);
+		assemble(batches[1], true);
+		close();
 	}
 	
+	//The builder chains by reference; copying would duplicate the 64 KB image
+	C64Prog(const C64Prog &) = delete;
+	C64Prog &operator=(const C64Prog &) = delete;
+	
 	~C64Prog()
 	{
 		if(cpu.log_file){
+			cpu.FlushTrace();
 			std::fflush(cpu.log_file);
 		}
 	}
@@ -212,17 +629,32 @@ class C64Prog
 
 unsigned long long C64Float::GetCycles()
 {
-	return cycles;
+	return CycleCounter::total();
+}
+
+unsigned long long C64Float::GetThreadCycles()
+{
+	return Counter().thread();
+}
+
+//Each thread keeps one execution context alive, which is reset between
+//operations rather than constructed from scratch
+static C64Prog &Context()
+{
+	static thread_local C64Prog ctx;
+	return ctx;
 }
 
 #if 0
-C64Prog NewProg(const char *func)
-#define NewProg() NewProg(__FUNCTION__)
+C64Prog &NewProg(C64Prog::Stub stub, const char *func)
+#define NewProg(stub) NewProg(stub, __FUNCTION__)
 #else
-C64Prog NewProg()
+C64Prog &NewProg(C64Prog::Stub stub)
 #endif
 {
-	C64Prog p;
+	C64Prog &p = Context();
+	p.reset();
+	p.load(stub);
 	
 	#ifdef NewProg
 	static std::unordered_map<std::string, int> count;
@@ -238,6 +670,8 @@ C64Prog NewProg()
 	std::sprintf(fn + strlen(fn), "_%d", d);
 	std::strcat(fn, ".log");
 	f = std::fopen(fn, "w");
+	p.cpu.FlushTrace();
+	if(p.cpu.log_file) std::fclose(p.cpu.log_file);
 	p.cpu.log_file = f;
 	#endif
 	
@@ -246,31 +680,40 @@ C64Prog NewProg()
 
 void C64Float::fromString(const char *str)
 {
-	size_t addrStr, addrFAC, addrARG;
-	NewProg()
-		.getAddr(addrStr)
-		.pushString(str)
-		.getAddr(addrFAC)
-		.reserve(5)
-		.begin()
-		.pushFIN(addrStr)
-		.pushMOVMF(addrFAC)
+	if(native){
+		C64Math m;
+		try{
+			m.FIN(str);
+			m.MOVMF(val);
+		}
+		catch(const C64Math::Error &){
+			std::memset(val, 0, sizeof(val));
+			std::raise(SIGFPE);
+		}
+		return;
+	}
+	
+	NewProg(C64Prog::STUB_FIN)
+		.setText(str)
+		.setFloat(C64Prog::SlotFAC, zero)
 		.execute()
-		.popFloat(addrFAC, *this);
+		.popFloat(C64Prog::SlotFAC, *this);
 }
 
 void C64Float::toString(char *out)
 {
-	size_t addrStr, addrFAC, addrARG;
 	char tmp[256];
-	NewProg()
-		.getAddr(addrFAC)
-		.pushFloat(*this)
-		.begin()
-		.pushMOVFM(addrFAC)
-		.pushFOUT()
-		.execute()
-		.popString(0x100, tmp);
+	if(native){
+		C64Math m;
+		m.MOVFM(val);
+		m.FOUT(tmp);
+	}
+	else{
+		NewProg(C64Prog::STUB_FOUT)
+			.setFloat(C64Prog::SlotFAC, *this)
+			.execute()
+			.popString(0x100, tmp);
+	}
 	//Fix lack of zero in string
 	char *c = tmp;
 	*out = 0;
@@ -290,250 +733,554 @@ void C64Float::toString(char *out)
 	strcpy(out, tmp);
 }
 
+//The native counterpart of the operator stubs: loads FAC from fac, runs
+//op with arg in memory and stores FAC. On an error the ROM never gets to
+//store it, so fac is returned as the stub would.
+static C64Float Native(const C64Float fac, const C64Float arg, void (C64Math::*op)(const uint8_t *))
+{
+	C64Math m;
+	C64Float result = fac;
+	try{
+		m.MOVFM(fac.val);
+		(m.*op)(arg.val);
+		m.MOVMF(result.val);
+	}
+	catch(const C64Math::Error &){
+		result = fac;
+		std::raise(SIGFPE);
+	}
+	return result;
+}
+
+//The same for the functions of FAC alone
+static C64Float Native(const C64Float fac, void (C64Math::*fn)())
+{
+	C64Math m;
+	C64Float result = fac;
+	try{
+		m.MOVFM(fac.val);
+		(m.*fn)();
+		m.MOVMF(result.val);
+	}
+	catch(const C64Math::Error &){
+		result = fac;
+		std::raise(SIGFPE);
+	}
+	return result;
+}
+
 C64Float C64Float::operator *(const C64Float other) const
 {
-	size_t addrStr, addrFAC, addrARG;
-	return NewProg()
-		.getAddr(addrFAC)
-		.pushFloat(*this)
-		.getAddr(addrARG)
-		.pushFloat(other)
-		.begin()
-		.pushMOVFM(addrFAC)
-		.pushFMUL(addrARG)
-		.pushMOVMF(addrFAC)
+	if(native) return Native(*this, other, &C64Math::FMUL);
+	
+	return NewProg(C64Prog::STUB_FMUL)
+		.setFloat(C64Prog::SlotFAC, *this)
+		.setFloat(C64Prog::SlotARG, other)
 		.execute()
-		.retFloat(addrFAC);
+		.retFloat(C64Prog::SlotFAC);
 }
 
 C64Float C64Float::operator +(const C64Float other) const
 {
-	size_t addrStr, addrFAC, addrARG;
-	return NewProg()
-		.getAddr(addrFAC)
-		.pushFloat(*this)
-		.getAddr(addrARG)
-		.pushFloat(other)
-		.begin()
-		.pushMOVFM(addrFAC)
-		.pushFADD(addrARG)
-		.pushMOVMF(addrFAC)
+	if(native) return Native(*this, other, &C64Math::FADD);
+	
+	return NewProg(C64Prog::STUB_FADD)
+		.setFloat(C64Prog::SlotFAC, *this)
+		.setFloat(C64Prog::SlotARG, other)
+		.execute()
+		.retFloat(C64Prog::SlotFAC);
+}
+
+C64Float C64Float::operator -(const C64Float other) const
+{
+	if(native) return Native(other, *this, &C64Math::FSUB);
+	
+	return NewProg(C64Prog::STUB_FSUB)
+		.setFloat(C64Prog::SlotFAC, other)
+		.setFloat(C64Prog::SlotARG, *this)
 		.execute()
-		.retFloat(addrFAC);
+		.retFloat(C64Prog::SlotFAC);
 }
 
-bool C64Float::operator >(const C64Float other) const
+C64Float C64Float::operator /(const C64Float other) const
 {
-	size_t addrStr, addrFAC, addrARG;
-	return NewProg()
-		.getAddr(addrFAC)
-		.pushFloat(*this)
-		.getAddr(addrARG)
-		.pushFloat(other)
-		.begin()
-		.pushMOVFM(addrFAC)
-		.pushFCOMP(addrARG)
+	if(native) return Native(other, *this, &C64Math::FDIV);
+	
+	return NewProg(C64Prog::STUB_FDIV)
+		.setFloat(C64Prog::SlotFAC, other)
+		.setFloat(C64Prog::SlotARG, *this)
 		.execute()
-		.retA() > 0;
+		.retFloat(C64Prog::SlotFAC);
+}
+
+//Assembles the program for an expression. Each operator leaves its
+//result in FAC and stores it with MOVMF, as the operators one by one do.
+//One that is the FAC operand of the next is loaded straight back with
+//MOVFM, one that is the ARG operand is stored to a scratch slot first.
+class Fuser
+{
+	public:
+	struct Node
+	{
+		char op;
+		unsigned int left, right;	//Nodes, or for 'f' the leaf
+	};
+	
+	C64Prog &p;
+	std::vector<Node> nodes;
+	size_t leaves, scratch, temp;
+	unsigned int depth;
+	
+	Fuser(C64Prog &p, const char *tree) : p(p), depth(0)
+	{
+		std::vector<unsigned int> stack;
+		unsigned int leaf = 0;
+		for(const char *t = tree; *t; t++){
+			Node node = {*t, leaf, 0};
+			if(*t == 'f'){
+				leaf++;
+			}
+			else{
+				node.right = stack.back();
+				stack.pop_back();
+				node.left = stack.back();
+				stack.pop_back();
+			}
+			stack.push_back(nodes.size());
+			nodes.push_back(node);
+		}
+	}
+	
+	//Where a leaf is, 0 for an operator
+	size_t Slot(unsigned int n)
+	{
+		return nodes[n].op == 'f' ? leaves + 5 * nodes[n].left : 0;
+	}
+	
+	//Runs node n and stores its result to dest, or with dest 0 leaves it
+	//in FAC as loading the stored result would
+	void Emit(unsigned int n, size_t dest)
+	{
+		const Node node = nodes[n];
+		bool commutes = node.op == '*' || node.op == '+';
+		unsigned int fac = commutes ? node.left : node.right;
+		unsigned int arg = commutes ? node.right : node.left;
+		
+		size_t addr = Slot(arg);
+		if(!addr){
+			addr = scratch + 5 * depth++;
+			Emit(arg, addr);
+		}
+		if(Slot(fac)) p.pushMOVFM(Slot(fac));
+		else Emit(fac, 0);
+		
+		switch(node.op){
+			case '*': p.pushFMUL(addr); break;
+			case '+': p.pushFADD(addr); break;
+			case '-': p.pushFSUB(addr); break;
+			default: p.pushFDIV(addr); break;
+		}
+		if(!Slot(arg)) depth--;
+		
+		if(dest) p.pushMOVMF(dest);
+		else p.pushMOVMF(temp).pushMOVFM(temp);
+	}
+	
+	//Leaves, scratch slots, a slot for the round trip and the result, then
+	//the code. All zero if it does not fit.
+	C64Prog::Fused Assemble()
+	{
+		C64Prog::Fused f = {};
+		size_t count = 0;
+		for(const Node &node : nodes) count += node.op == 'f';
+		
+		p.open()
+			.allocate(leaves, 5 * count)
+			.allocate(scratch, 5 * count)
+			.allocate(temp, 5)
+			.allocate(f.result, 5)
+			.begin();
+		Emit(nodes.size() - 1, f.result);
+		if(!p.close()) return C64Prog::Fused{};
+		f.leaves = leaves;
+		f.program.start = p.start;
+		f.program.end = p.prg;
+		return f;
+	}
+};
+
+//The number of leaves in well-formed postfix text, else 0
+static size_t Leaves(const char *tree)
+{
+	size_t count = 0, depth = 0;
+	for(const char *t = tree; *t; t++){
+		if(*t == 'f'){
+			count++;
+			depth++;
+		}
+		else if(std::strchr("*+-/", *t) && depth >= 2){
+			depth--;
+		}
+		else{
+			return 0;
+		}
+	}
+	return depth == 1 ? count : 0;
 }
 
-bool C64Float::operator ==(const C64Float other) const
+//The operators one by one
+static C64Float Stepwise(const char *tree, const C64Float *leaves)
 {
-	if(!val[0] && !other.val[0]) return 1;
-	return !memcmp(val, other.val, sizeof(val));
+	std::vector<C64Float> stack;
+	for(const char *t = tree; *t; t++){
+		if(*t == 'f'){
+			stack.push_back(*leaves++);
+			continue;
+		}
+		C64Float b = stack.back();
+		stack.pop_back();
+		C64Float &a = stack.back();
+		if(*t == '*') a = a * b;
+		else if(*t == '+') a = a + b;
+		else if(*t == '-') a = a - b;
+		else a = a / b;
+	}
+	return stack.back();
 }
 
-C64Float C64Float::abs()
+C64Float C64Float::Fuse(const char *tree, const C64Float *leaves)
 {
-	size_t addrStr, addrFAC, addrARG;
-	return NewProg()
-		.getAddr(addrFAC)
-		.pushFloat(*this)
-		.begin()
-		.pushMOVFM(addrFAC)
-		.pushABS()
-		.pushMOVMF(addrFAC)
-		.execute()
-		.retFloat(addrFAC);
+	size_t count = Leaves(tree);
+	if(!count) return zero;
+	
+	if(!native && count > 1){
+		C64Prog &p = Context();
+		auto found = p.fused.find(tree);
+		if(found == p.fused.end()){
+			found = p.fused.emplace(tree, Fuser(p, tree).Assemble()).first;
+		}
+		const C64Prog::Fused &f = found->second;
+		if(f.program.start){
+			p.reset();
+			p.load(f.program);
+			for(size_t i = 0; i < count; i++) p.setFloat(f.leaves + 5 * i, leaves[i]);
+			if(p.run()){
+				Counter().add(p.used);
+				C64Float result;
+				p.popFloat(f.result, result);
+				return result;
+			}
+		}
+	}
+	return Stepwise(tree, leaves);
 }
 
-C64Float C64Float::operator -(const C64Float other) const
+//Runs routine over each element, a block at a time. An element the ROM
+//fails on is redone by scalar, which raises SIGFPE and gives what the
+//operator would, and the loop goes on from the next.
+template<class Scalar>
+static void Batch(uint16_t routine, const C64Float *fac, const C64Float *arg, C64Float *out, size_t n, Scalar scalar)
 {
-	size_t addrStr, addrFAC, addrARG;
-	return NewProg()
-		.getAddr(addrFAC)
-		.pushFloat(other)
-		.getAddr(addrARG)
-		.pushFloat(*this)
-		.begin()
-		.pushMOVFM(addrFAC)
-		.pushFSUB(addrARG)
-		.pushMOVMF(addrFAC)
-		.execute()
-		.retFloat(addrFAC);
+	if(C64Float::native){
+		for(size_t i = 0; i < n; i++) out[i] = scalar(i);
+		return;
+	}
+	
+	C64Prog &p = Context();
+	const C64Prog::Batch &batch = p.batches[arg != nullptr];
+	size_t block = (C64Prog::BatchEnd - C64Prog::BatchArea) / (arg ? 10 : 5);
+	size_t i = 0;
+	while(i < n){
+		size_t count = std::min(n - i, block);
+		size_t facs = C64Prog::BatchArea, args = facs + 5 * count;
+		p.reset();
+		for(size_t j = 0; j < count; j++){
+			p.setFloat(facs + 5 * j, fac[i + j]);
+			if(arg) p.setFloat(args + 5 * j, arg[i + j]);
+		}
+		p.patch(batch, routine, (arg ? args : facs) + 5 * count);
+		p.ram[C64Prog::BatchFAC] = facs & 0xFFu;
+		p.ram[C64Prog::BatchFAC + 1] = facs >> 8u;
+		p.ram[C64Prog::BatchARG] = args & 0xFFu;
+		p.ram[C64Prog::BatchARG + 1] = args >> 8u;
+		
+		//The element that fails is counted when redone
+		bool ok = p.load(batch.program).run(C64Prog::MaxCycles * count, batch.program.start - p.ram);
+		Counter().add(ok ? p.used : p.marked);
+		size_t done = count;
+		if(!ok) done = ((p.ram[C64Prog::BatchFAC] | p.ram[C64Prog::BatchFAC + 1] << 8u) - facs) / 5;
+		for(size_t j = 0; j < done; j++) p.popFloat(facs + 5 * j, out[i + j]);
+		i += done;
+		if(!ok){
+			out[i] = scalar(i);
+			i++;
+		}
+	}
 }
 
-C64Float C64Float::operator /(const C64Float other) const
+//FAC is the first operand for FMUL and FADD, the second for FSUB and FDIV
+void C64Float::mul(const C64Float *a, const C64Float *b, C64Float *out, size_t n)
 {
-	size_t addrStr, addrFAC, addrARG;
-	return NewProg()
-		.getAddr(addrFAC)
-		.pushFloat(other)
-		.getAddr(addrARG)
-		.pushFloat(*this)
-		.begin()
-		.pushMOVFM(addrFAC)
-		.pushFDIV(addrARG)
-		.pushMOVMF(addrFAC)
-		.execute()
-		.retFloat(addrFAC);
+	Batch(0xBA28, a, b, out, n, [=](size_t i){ return a[i] * b[i]; });
+}
+
+void C64Float::add(const C64Float *a, const C64Float *b, C64Float *out, size_t n)
+{
+	Batch(0xB867, a, b, out, n, [=](size_t i){ return a[i] + b[i]; });
+}
+
+void C64Float::sub(const C64Float *a, const C64Float *b, C64Float *out, size_t n)
+{
+	Batch(0xB850, b, a, out, n, [=](size_t i){ return a[i] - b[i]; });
+}
+
+void C64Float::div(const C64Float *a, const C64Float *b, C64Float *out, size_t n)
+{
+	Batch(0xBB0F, b, a, out, n, [=](size_t i){ return a[i] / b[i]; });
+}
+
+void C64Float::sqrt(const C64Float *in, C64Float *out, size_t n)
+{
+	Batch(0xBF71, in, nullptr, out, n, [=](size_t i){ C64Float f = in[i]; return f.sqrt(); });
+}
+
+void C64Float::atan(const C64Float *in, C64Float *out, size_t n)
+{
+	Batch(0xE30E, in, nullptr, out, n, [=](size_t i){ C64Float f = in[i]; return f.atan(); });
+}
+
+void C64Float::cos(const C64Float *in, C64Float *out, size_t n)
+{
+	Batch(0xE264, in, nullptr, out, n, [=](size_t i){ C64Float f = in[i]; return f.cos(); });
+}
+
+void C64Float::exp(const C64Float *in, C64Float *out, size_t n)
+{
+	Batch(0xBFED, in, nullptr, out, n, [=](size_t i){ C64Float f = in[i]; return f.exp(); });
+}
+
+void C64Float::sin(const C64Float *in, C64Float *out, size_t n)
+{
+	Batch(0xE26B, in, nullptr, out, n, [=](size_t i){ C64Float f = in[i]; return f.sin(); });
+}
+
+void C64Float::tan(const C64Float *in, C64Float *out, size_t n)
+{
+	Batch(0xE2B4, in, nullptr, out, n, [=](size_t i){ C64Float f = in[i]; return f.tan(); });
+}
+
+void C64Float::log(const C64Float *in, C64Float *out, size_t n)
+{
+	Batch(0xB9EA, in, nullptr, out, n, [=](size_t i){ C64Float f = in[i]; return f.log(); });
 }
 
 C64Float C64Float::sqrt()
 {
-	size_t addrStr, addrFAC, addrARG;
-	return NewProg()
-		.getAddr(addrFAC)
-		.pushFloat(*this)
-		.begin()
-		.pushMOVFM(addrFAC)
-		.pushSQR()
-		.pushMOVMF(addrFAC)
+	if(native) return Native(*this, &C64Math::SQR);
+	
+	return NewProg(C64Prog::STUB_SQR)
+		.setFloat(C64Prog::SlotFAC, *this)
 		.execute()
-		.retFloat(addrFAC);
+		.retFloat(C64Prog::SlotFAC);
 }
 
 C64Float C64Float::atan()
 {
-	size_t addrStr, addrFAC, addrARG;
-	return NewProg()
-		.getAddr(addrFAC)
-		.pushFloat(*this)
-		.begin()
-		.pushMOVFM(addrFAC)
-		.pushATN()
-		.pushMOVMF(addrFAC)
+	if(native) return Native(*this, &C64Math::ATN);
+	
+	return NewProg(C64Prog::STUB_ATN)
+		.setFloat(C64Prog::SlotFAC, *this)
 		.execute()
-		.retFloat(addrFAC);
+		.retFloat(C64Prog::SlotFAC);
 }
 
 C64Float C64Float::cos()
 {
-	size_t addrStr, addrFAC, addrARG;
-	return NewProg()
-		.getAddr(addrFAC)
-		.pushFloat(*this)
-		.begin()
-		.pushMOVFM(addrFAC)
-		.pushCOS()
-		.pushMOVMF(addrFAC)
+	if(native) return Native(*this, &C64Math::COS);
+	
+	return NewProg(C64Prog::STUB_COS)
+		.setFloat(C64Prog::SlotFAC, *this)
 		.execute()
-		.retFloat(addrFAC);
+		.retFloat(C64Prog::SlotFAC);
 }
 
 C64Float C64Float::exp()
 {
-	size_t addrStr, addrFAC, addrARG;
-	return NewProg()
-		.getAddr(addrFAC)
-		.pushFloat(*this)
-		.begin()
-		.pushMOVFM(addrFAC)
-		.pushEXP()
-		.pushMOVMF(addrFAC)
+	if(native) return Native(*this, &C64Math::EXP);
+	
+	return NewProg(C64Prog::STUB_EXP)
+		.setFloat(C64Prog::SlotFAC, *this)
 		.execute()
-		.retFloat(addrFAC);
+		.retFloat(C64Prog::SlotFAC);
 }
 
 C64Float C64Float::pow(const C64Float other)
 {
-	size_t addrStr, addrFAC, addrARG;
-	return NewProg()
-		.getAddr(addrFAC)
-		.pushFloat(other)
-		.getAddr(addrARG)
-		.pushFloat(*this)
-		.begin()
-		.pushMOVFM(addrFAC)
-		.pushCONUPK(addrARG)
-		.pushPWR_()
-		.pushMOVMF(addrFAC)
+	if(native){
+		C64Math m;
+		C64Float result = other;
+		try{
+			m.MOVFM(other.val);
+			m.CONUPK(val);
+			m.FPWRT();
+			m.MOVMF(result.val);
+		}
+		catch(const C64Math::Error &){
+			result = other;
+			std::raise(SIGFPE);
+		}
+		return result;
+	}
+	
+	return NewProg(C64Prog::STUB_PWR)
+		.setFloat(C64Prog::SlotFAC, other)
+		.setFloat(C64Prog::SlotARG, *this)
 		.execute()
-		.retFloat(addrFAC);
+		.retFloat(C64Prog::SlotFAC);
 }
 
 C64Float C64Float::sin()
 {
-	size_t addrStr, addrFAC, addrARG;
-	return NewProg()
-		.getAddr(addrFAC)
-		.pushFloat(*this)
-		.begin()
-		.pushMOVFM(addrFAC)
-		.pushSIN()
-		.pushMOVMF(addrFAC)
+	if(native) return Native(*this, &C64Math::SIN);
+	
+	return NewProg(C64Prog::STUB_SIN)
+		.setFloat(C64Prog::SlotFAC, *this)
 		.execute()
-		.retFloat(addrFAC);
+		.retFloat(C64Prog::SlotFAC);
 }
 
 C64Float C64Float::tan()
 {
-	size_t addrStr, addrFAC, addrARG;
-	return NewProg()
-		.getAddr(addrFAC)
-		.pushFloat(*this)
-		.begin()
-		.pushMOVFM(addrFAC)
-		.pushTAN()
-		.pushMOVMF(addrFAC)
+	if(native) return Native(*this, &C64Math::TAN);
+	
+	return NewProg(C64Prog::STUB_TAN)
+		.setFloat(C64Prog::SlotFAC, *this)
 		.execute()
-		.retFloat(addrFAC);
+		.retFloat(C64Prog::SlotFAC);
 }
 
 C64Float C64Float::log()
 {
-	size_t addrStr, addrFAC, addrARG;
-	return NewProg()
-		.getAddr(addrFAC)
-		.pushFloat(*this)
-		.begin()
-		.pushMOVFM(addrFAC)
-		.pushLOG()
-		.pushMOVMF(addrFAC)
+	if(native) return Native(*this, &C64Math::LOG);
+	
+	return NewProg(C64Prog::STUB_LOG)
+		.setFloat(C64Prog::SlotFAC, *this)
 		.execute()
-		.retFloat(addrFAC);
+		.retFloat(C64Prog::SlotFAC);
 }
 
+//INT of the value plus a half, stored in between as the add stub did
 C64Float C64Float::round()
 {
-	size_t addrStr, addrFAC, addrARG;
-	return NewProg()
-		.getAddr(addrFAC)
-		.pushFloat((*this) + C64Float("0.5"))
-		.begin()
-		.pushMOVFM(addrFAC)
-		.pushINT()
-		.pushMOVMF(addrFAC)
-		.execute()
-		.retFloat(addrFAC);
+	return Native(Native(*this, 0.5_C64F, &C64Math::FADD), &C64Math::INT);
 }
 
+//QINT leaves the integer big-endian in the mantissa
 C64Float::operator int() const
 {
-	size_t addrStr, addrFAC, addrARG;
-	return NewProg()
-		.getAddr(addrFAC)
-		.pushFloat(*this)
-		.begin()
-		.pushMOVFM(addrFAC)
-		.pushQINT()
-		.execute()
-		.retIntBigEndian(0x62);
+	C64Math m;
+	m.MOVFM(val);
+	m.QINT();
+	const uint8_t *i = m.zp + C64Math::FAC + 1;
+	return (int) ((uint32_t) i[0] << 24 | i[1] << 16 | i[2] << 8 | i[3]);
 }
 
-C64Float operator "" _C64F(const char *str)
+//Puts the value in FAC, or in ARG with at set to it, as MOVFM or CONUPK
+//would load it had it been stored
+static void Load(C64Math &m, uint8_t at, const C64FloatUnpacked u)
 {
-	return C64Float(str);
+	m.zp[at] = u.exponent;
+	m.zp[at + 1] = u.mantissa >> 24;
+	m.zp[at + 2] = u.mantissa >> 16;
+	m.zp[at + 3] = u.mantissa >> 8;
+	m.zp[at + 4] = u.mantissa;
+	m.zp[at + 5] = u.sign;
+	if(at == C64Math::FAC) m.zp[C64Math::FACEXTENSION] = u.rounding;
+}
+
+//ROUND, then what MOVMF stores and MOVFM loads back, without the bytes
+static C64FloatUnpacked Save(C64Math &m)
+{
+	m.ROUND();
+	const uint8_t *f = m.zp + C64Math::FAC;
+	uint8_t top = (m.zp[C64Math::FACSIGN] | 0x7Fu) & f[1];
+	C64FloatUnpacked u;
+	u.exponent = f[0];
+	u.mantissa = (uint32_t) (top | 0x80u) << 24 | f[2] << 16 | f[3] << 8 | f[4];
+	u.sign = top;
+	u.rounding = 0;
+	return u;
+}
+
+//Rounds a value left with its rounding byte. If that overflows, SIGFPE
+//is raised and the value is kept as it is, as MOVMF would store it.
+static C64FloatUnpacked Rounded(const C64FloatUnpacked u)
+{
+	if(!u.rounding) return u;
+	C64Math m;
+	Load(m, C64Math::FAC, u);
+	try{
+		return Save(m);
+	}
+	catch(const C64Math::Error &){
+		C64FloatUnpacked kept = u;
+		kept.rounding = 0;
+		std::raise(SIGFPE);
+		return kept;
+	}
+}
+
+//Native() for values already in FAC form: the operands are put straight
+//into FAC and ARG, and the result taken back out of FAC
+static C64FloatUnpacked Native(const C64FloatUnpacked fac, const C64FloatUnpacked arg, void (C64Math::*op)())
+{
+	C64Math m;
+	C64FloatUnpacked result = Rounded(fac);
+	try{
+		Load(m, C64Math::FAC, result);
+		Load(m, C64Math::ARG, Rounded(arg));
+		m.zp[C64Math::SGNCPR] = m.zp[C64Math::ARGSIGN] ^ m.zp[C64Math::FACSIGN];
+		(m.*op)();
+		result = Save(m);
+	}
+	catch(const C64Math::Error &){
+		std::raise(SIGFPE);
+	}
+	return result;
+}
+
+C64FloatUnpacked::operator C64Float() const
+{
+	C64FloatUnpacked u = Rounded(*this);
+	return C64Float(u.exponent, (u.sign | 0x7Fu) & (u.mantissa >> 24), u.mantissa >> 16, u.mantissa >> 8, u.mantissa);
+}
+
+C64FloatUnpacked C64FloatUnpacked::operator *(const C64FloatUnpacked other) const
+{
+	return Native(*this, other, &C64Math::FMULT);
+}
+
+C64FloatUnpacked C64FloatUnpacked::operator +(const C64FloatUnpacked other) const
+{
+	return Native(*this, other, &C64Math::FADDT);
+}
+
+C64FloatUnpacked C64FloatUnpacked::operator -(const C64FloatUnpacked other) const
+{
+	return Native(other, *this, &C64Math::FSUBT);
+}
+
+C64FloatUnpacked C64FloatUnpacked::operator /(const C64FloatUnpacked other) const
+{
+	return Native(other, *this, &C64Math::FDIVT);
+}
+
+//As negating the stored value
+C64FloatUnpacked C64FloatUnpacked::operator -() const
+{
+	C64FloatUnpacked u = Rounded(*this);
+	u.sign ^= 0x80u;
+	return u;
 }
 
 #include <cmath>
@@ -551,25 +1298,66 @@ double C64Float::toDouble()
 	return std::pow(2.0, exp) * double(mantissa) / double(0x80u << 24);
 }
 
-C64Float C64Float::operator -() const
+
+//Stores a mantissa with its top bit set, and the exponent byte
+static void Pack(C64Float &f, uint32_t mantissa, int exp, bool negative)
 {
-	C64Float res = *this;
-	res.val[1] ^= (1u << 7);
-	return res;
+	f.val[0] = exp;
+	f.val[1] = ((mantissa >> 24) & 0x7Fu) | (negative ? 0x80u : 0u);
+	f.val[2] = mantissa >> 16;
+	f.val[3] = mantissa >> 8;
+	f.val[4] = mantissa;
 }
 
+//Every int fits the 32 bit mantissa, so this is exact
 C64Float::C64Float(int i)
 {
-	char str[256] = {};
-	std::sprintf(str, "%d", i);
-	fromString(str);
-	//std::printf("C64Float(%d)\n", i);
+	if(legacyConversion){
+		char str[256] = {};
+		std::sprintf(str, "%d", i);
+		fromString(str);
+		return;
+	}
+	
+	std::memset(val, 0, sizeof(val));
+	if(i == 0) return;
+	uint32_t mantissa = i < 0 ? 0u - (uint32_t) i : (uint32_t) i;
+	int exp = 0xA0;
+	while(!(mantissa & 0x80000000u)){
+		mantissa <<= 1;
+		exp--;
+	}
+	Pack(*this, mantissa, exp, i < 0);
 }
 
+//Rounds to the nearest value, halves away from zero as ROUND does. Too
+//large a value raises SIGFPE and gives 0, as parsing it would.
 C64Float::C64Float(double d)
 {
-	char str[256] = {};
-	std::sprintf(str, "%f", d);
-	fromString(str);
-	//std::printf("C64Float(%f)\n", d);
+	if(legacyConversion){
+		char str[256] = {};
+		std::sprintf(str, "%f", d);
+		fromString(str);
+		return;
+	}
+	
+	std::memset(val, 0, sizeof(val));
+	if(!std::isfinite(d)){
+		std::raise(SIGFPE);
+		return;
+	}
+	if(d == 0) return;
+	int exp;
+	double mantissa = std::round(std::ldexp(std::frexp(std::fabs(d), &exp), 32));
+	if(mantissa >= 4294967296.0){
+		mantissa = 2147483648.0;
+		exp++;
+	}
+	exp += 0x80;
+	if(exp <= 0) return;
+	if(exp > 0xFF){
+		std::raise(SIGFPE);
+		return;
+	}
+	Pack(*this, (uint32_t) mantissa, exp, d < 0);
 }
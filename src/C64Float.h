@@ -1,11 +1,26 @@
 #include <stdint.h>
+#include <stddef.h>
+
+#include "C64Math.h"
 
 class C64Float
 {
 	public:
 	uint8_t val[5];
 	
-	static C64Float zero, unit;
+	static const C64Float zero, unit;
+	
+	//Arithmetic, the string conversions and the functions run as native
+	//code, with results identical to the ROM
+	//routines, instead of on the emulated machine. It then does not need
+	//the ROM images and adds nothing to GetCycles(). Comparisons, abs,
+	//round and int are always native.
+	static bool native;
+	
+	//C64Float(int) and C64Float(double) print the number with sprintf and
+	//parse that, as they used to, instead of converting directly. For
+	//results identical to older versions; "%f" keeps only six decimals.
+	static bool legacyConversion;
 	
 	void fromString(const char *str);
 	void toString(char *out);
@@ -13,13 +28,48 @@ class C64Float
 	C64Float operator +(const C64Float other) const;
 	C64Float operator -(const C64Float other) const;
 	C64Float operator /(const C64Float other) const;
-	bool operator >(const C64Float other) const;
-	bool operator ==(const C64Float other) const;
+	
+	//An expression in postfix, 'f' for each of leaves in turn and * + - /
+	//for the operators: "ff*f+" is leaves[0] * leaves[1] + leaves[2].
+	//Emulated, it runs as one program, assembled when the text is first
+	//seen. Each intermediate result is still stored and loaded back with
+	//MOVMF and MOVFM, so the bytes are those the operators one by one
+	//give. On an error the operators are applied one by one, so SIGFPE
+	//is raised at the same one. Malformed text gives zero.
+	static C64Float Fuse(const char *tree, const C64Float *leaves);
+	
+	//FCOMP on the packed bytes: 1 if this is greater, -1 if smaller, else
+	//0. Any value with a zero exponent is 0, whatever its other bytes.
+	int Compare(const C64Float other) const
+	{
+		int sign = (val[1] & 0x80u) ? -1 : 1;
+		if(!other.val[0]) return val[0] ? sign : 0;
+		if((val[1] ^ other.val[1]) & 0x80u) return sign;
+		if(val[0] != other.val[0]) return val[0] > other.val[0] ? sign : -sign;
+		for(unsigned int i = 1; i < 5; i++){
+			if(val[i] != other.val[i]) return val[i] > other.val[i] ? sign : -sign;
+		}
+		return 0;
+	}
+	
+	bool operator >(const C64Float other) const{  return Compare(other) > 0; }
+	bool operator <(const C64Float other) const{  return Compare(other) < 0; }
+	bool operator >=(const C64Float other) const{ return Compare(other) >= 0; }
+	bool operator <=(const C64Float other) const{ return Compare(other) <= 0; }
+	bool operator ==(const C64Float other) const{ return Compare(other) == 0; }
+	bool operator !=(const C64Float other) const{ return Compare(other) != 0; }
+	
 	operator int() const;
-	C64Float operator -() const;
+	constexpr C64Float operator -() const
+	{
+		return C64Float(val[0], val[1] ^ (1u << 7), val[2], val[3], val[4]);
+	}
 	
 	C64Float sqrt();
-	C64Float abs();
+	C64Float abs() const
+	{
+		return C64Float(val[0], val[1] & 0x7Fu, val[2], val[3], val[4]);
+	}
 	C64Float atan();
 	C64Float cos();
 	C64Float exp();
@@ -30,15 +80,36 @@ class C64Float
 	
 	C64Float pow(C64Float other);
 	
+	//The operators and functions over arrays of n elements, with the same
+	//results, emulated as a single 6502 loop over each block of operands
+	//copied into RAM. out may be one of the inputs. They are no faster
+	//than a loop over the operators: the ROM routine is most of the cost
+	//of each element, and stepping through the block adds 22 cycles to a
+	//function and 37 to an operator.
+	static void mul(const C64Float *a, const C64Float *b, C64Float *out, size_t n);
+	static void add(const C64Float *a, const C64Float *b, C64Float *out, size_t n);
+	static void sub(const C64Float *a, const C64Float *b, C64Float *out, size_t n);
+	static void div(const C64Float *a, const C64Float *b, C64Float *out, size_t n);
+	static void sqrt(const C64Float *in, C64Float *out, size_t n);
+	static void atan(const C64Float *in, C64Float *out, size_t n);
+	static void cos(const C64Float *in, C64Float *out, size_t n);
+	static void exp(const C64Float *in, C64Float *out, size_t n);
+	static void sin(const C64Float *in, C64Float *out, size_t n);
+	static void tan(const C64Float *in, C64Float *out, size_t n);
+	static void log(const C64Float *in, C64Float *out, size_t n);
+	
 	C64Float operator *=(const C64Float other){ *this = *this * other; return *this; }
 	C64Float operator +=(const C64Float other){ *this = *this + other; return *this; }
 	C64Float operator /=(const C64Float other){ *this = *this / other; return *this; }
 	C64Float operator -=(const C64Float other){ *this = *this - other; return *this; }
 	C64Float operator ++(){ *this += unit; return *this; }
 	C64Float operator --(){ *this -= unit; return *this; }
-	bool operator <(C64Float other)  const{ return !((*this) == other) && !((*this) > other); }
 	
+	//Cycles run on the emulated machine by all threads, and by the calling
+	//one. Each thread runs on its own machine, so threads only share the
+	//two settings above, which are best set before starting them.
 	static unsigned long long GetCycles();
+	static unsigned long long GetThreadCycles();
 	
 	double toDouble();
 	
@@ -46,6 +117,10 @@ class C64Float
 	{
 	}
 	
+	constexpr C64Float(uint8_t b0, uint8_t b1, uint8_t b2, uint8_t b3, uint8_t b4) : val{b0, b1, b2, b3, b4}
+	{
+	}
+	
 	C64Float(const char *str)
 	{
 		fromString(str);
@@ -53,8 +128,94 @@ class C64Float
 	
 	C64Float(int i);
 	C64Float(double d);
+	
+	//FIN when compiling, for the literals
+	static constexpr C64Float Parse(const char *str)
+	{
+		C64Math m;
+		uint8_t f[5] = {};
+		m.FIN(str);
+		m.MOVMF(f);
+		return C64Float(f[0], f[1], f[2], f[3], f[4]);
+	}
 };
 
+constexpr C64Float C64Float::zero(0x00, 0x00, 0x00, 0x00, 0x00), C64Float::unit(0x81, 0x00, 0x00, 0x00, 0x00);
+
+//A value laid out as FAC holds it, for chains of arithmetic that would
+//otherwise store every result with MOVMF and load it back with MOVFM.
+//Each result is rounded as MOVMF rounds it, so a chain gives what the
+//C64Float operators give, byte for byte. Always runs as native code.
+class C64FloatUnpacked
+{
+	public:
+	uint8_t exponent;
+	uint32_t mantissa;		//Top bit set, unless the exponent is 0
+	uint8_t sign;			//FACSIGN, the sign in bit 7
+	uint8_t rounding;		//FACEXTENSION, 0 once rounded
+	
+	C64FloatUnpacked()
+	{
+	}
+	
+	//MOVFM
+	explicit C64FloatUnpacked(const C64Float f) :
+		exponent(f.val[0]),
+		mantissa((uint32_t) (f.val[1] | 0x80u) << 24 | f.val[2] << 16 | f.val[3] << 8 | f.val[4]),
+		sign(f.val[1]),
+		rounding(0)
+	{
+	}
+	
+	//MOVMF, the only place the value is packed
+	operator C64Float() const;
+	
+	C64FloatUnpacked operator *(const C64FloatUnpacked other) const;
+	C64FloatUnpacked operator +(const C64FloatUnpacked other) const;
+	C64FloatUnpacked operator -(const C64FloatUnpacked other) const;
+	C64FloatUnpacked operator /(const C64FloatUnpacked other) const;
+	C64FloatUnpacked operator -() const;
+	
+	C64FloatUnpacked operator *(const C64Float other) const{ return *this * C64FloatUnpacked(other); }
+	C64FloatUnpacked operator +(const C64Float other) const{ return *this + C64FloatUnpacked(other); }
+	C64FloatUnpacked operator -(const C64Float other) const{ return *this - C64FloatUnpacked(other); }
+	C64FloatUnpacked operator /(const C64Float other) const{ return *this / C64FloatUnpacked(other); }
+	
+	C64FloatUnpacked operator *=(const C64FloatUnpacked other){ *this = *this * other; return *this; }
+	C64FloatUnpacked operator +=(const C64FloatUnpacked other){ *this = *this + other; return *this; }
+	C64FloatUnpacked operator /=(const C64FloatUnpacked other){ *this = *this / other; return *this; }
+	C64FloatUnpacked operator -=(const C64FloatUnpacked other){ *this = *this - other; return *this; }
+	C64FloatUnpacked operator *=(const C64Float other){ *this = *this * other; return *this; }
+	C64FloatUnpacked operator +=(const C64Float other){ *this = *this + other; return *this; }
+	C64FloatUnpacked operator /=(const C64Float other){ *this = *this / other; return *this; }
+	C64FloatUnpacked operator -=(const C64Float other){ *this = *this - other; return *this; }
+};
+
+static C64FloatUnpacked operator *(const C64Float f, const C64FloatUnpacked u){ return C64FloatUnpacked(f) * u; }
+static C64FloatUnpacked operator +(const C64Float f, const C64FloatUnpacked u){ return C64FloatUnpacked(f) + u; }
+static C64FloatUnpacked operator -(const C64Float f, const C64FloatUnpacked u){ return C64FloatUnpacked(f) - u; }
+static C64FloatUnpacked operator /(const C64Float f, const C64FloatUnpacked u){ return C64FloatUnpacked(f) / u; }
+
+//Literals are parsed when compiling, to what C64Float(str) would give.
+//One too large for the format does not compile.
+template<char... str>
+constexpr C64Float operator "" _C64F()
+{
+	constexpr char text[] = {str..., 0};
+	constexpr C64Float f = C64Float::Parse(text);
+	return f;
+}
+
+//The same for "1.5"_C64F, a GNU extension that only GCC and Clang have.
+//Clang warns about it with -Wgnu-string-literal-operator-template.
+template<typename T, T... str>
+constexpr C64Float operator "" _C64F()
+{
+	constexpr char text[] = {str..., 0};
+	constexpr C64Float f = C64Float::Parse(text);
+	return f;
+}
+
 static C64Float round(C64Float f){ return f.round(); }
 static C64Float abs(C64Float f){ return f.abs(); }
 static C64Float sqrt(C64Float f){ return f.sqrt(); }
@@ -65,7 +226,5 @@ static C64Float pow(C64Float f1, C64Float f2){ return f1.pow(f2); }
 static C64Float log(C64Float f){ return f.log(); }
 static C64Float sin(C64Float f){ return f.sin(); }
 static C64Float cos(C64Float f){ return f.cos(); }
-static C64Float log2(C64Float f){ return log(f) / log(C64Float("2")); }
-static C64Float log10(C64Float f){ return log(f) / log(C64Float("10")); }
-
-C64Float operator "" _C64F(const char *);
+static C64Float log2(C64Float f){ return log(f) / log(2_C64F); }
+static C64Float log10(C64Float f){ return log(f) / log(10_C64F); }
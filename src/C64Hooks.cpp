@@ -0,0 +1,282 @@
+#include "C64Hooks.h"
+
+#include <initializer_list>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+//Cycles taken by a run of instructions, from the opcode table
+static constexpr unsigned int Cycles(std::initializer_list<uint8_t> ops)
+{
+	unsigned int cycles = 0;
+	for(uint8_t op : ops) cycles += opCodes[op].cycles;
+	return cycles;
+}
+
+//The return address left below the stack pointer by a JSR at pc, at
+//the given depth of nested calls
+static void PushedReturn(C64Machine &cpu, unsigned int depth, uint16_t pc)
+{
+	uint8_t s = cpu.registers.s - 2u * depth;
+	cpu.memory.WriteByte(0x0100u | s, (pc + 2u) >> 8u);
+	cpu.memory.WriteByte(0x0100u | (uint8_t) (s - 1u), (pc + 2u) & 0xFFu);
+}
+
+//STA ($22),Y. The pointer is read each time, as a destination overlapping
+//it changes where the following bytes go
+static void StoreIndirect(C64Memory &m, uint8_t y, uint8_t value)
+{
+	uint16_t to = m.ReadByte(0x22) | (m.ReadByte(0x23) << 8u);
+	m.WriteByte(to + y, value);
+}
+
+//Extra cycle of LDA (zp),Y, with the same test as MachineT::DoStep
+static unsigned int Penalty(uint16_t base, uint8_t y)
+{
+	uint8_t temp8 = ~(base & 0xFFu);
+	return temp8 <= y;
+}
+
+//All the routines are in the BASIC ROM
+static bool Banked(C64Machine &cpu)
+{
+	return cpu.memory.basicIn;
+}
+
+//$BBA2 MOVFM: loads FAC from the float at A/Y
+static bool MOVFM(C64Machine &cpu, unsigned int &cycles)
+{
+	if(!Banked(cpu)) return false;
+	C64Memory &m = cpu.memory;
+	C64Machine::Registers &r = cpu.registers;
+	uint16_t from = r.a | (r.y << 8u);
+	uint8_t b;
+
+	cycles = Cycles({
+		0x85, 0x84, 0xA0,				//STA $22, STY $23, LDY #4
+		0xB1, 0x85, 0x88,				//LDA ($22),Y, STA $65, DEY
+		0xB1, 0x85, 0x88,				//LDA ($22),Y, STA $64, DEY
+		0xB1, 0x85, 0x88,				//LDA ($22),Y, STA $63, DEY
+		0xB1, 0x85, 0x09, 0x85, 0x88,	//LDA ($22),Y, STA $66, ORA #$80, STA $62, DEY
+		0xB1, 0x85, 0x84, 0x60			//LDA ($22),Y, STA $61, STY $70, RTS
+	});
+	for(unsigned int y = 0; y <= 4; y++) cycles += Penalty(from, y);
+
+	m.WriteByte(0x22, r.a);
+	m.WriteByte(0x23, r.y);
+	b = m.ReadByte(from + 4u);
+	m.WriteByte(0x65, b);
+	b = m.ReadByte(from + 3u);
+	m.WriteByte(0x64, b);
+	b = m.ReadByte(from + 2u);
+	m.WriteByte(0x63, b);
+	b = m.ReadByte(from + 1u);
+	m.WriteByte(0x66, b);
+	m.WriteByte(0x62, b | 0x80u);
+	b = m.ReadByte(from);
+	m.WriteByte(0x61, b);
+	m.WriteByte(0x70, 0);
+
+	r.a = b;
+	r.y = 0;
+	cpu.SetNZ(b);
+	cpu.ReturnFromHook();
+	return true;
+}
+
+//$BA8C CONUPK: loads ARG from the float at A/Y and sets the sign
+//comparison byte $6F
+static bool CONUPK(C64Machine &cpu, unsigned int &cycles)
+{
+	if(!Banked(cpu)) return false;
+	C64Memory &m = cpu.memory;
+	C64Machine::Registers &r = cpu.registers;
+	uint16_t from = r.a | (r.y << 8u);
+	uint8_t b;
+
+	cycles = Cycles({
+		0x85, 0x84, 0xA0,				//STA $22, STY $23, LDY #4
+		0xB1, 0x85, 0x88,				//LDA ($22),Y, STA $6D, DEY
+		0xB1, 0x85, 0x88,				//LDA ($22),Y, STA $6C, DEY
+		0xB1, 0x85, 0x88,				//LDA ($22),Y, STA $6B, DEY
+		0xB1, 0x85, 0x45, 0x85,			//LDA ($22),Y, STA $6E, EOR $66, STA $6F
+		0xA5, 0x09, 0x85, 0x88,			//LDA $6E, ORA #$80, STA $6A, DEY
+		0xB1, 0x85, 0xA5, 0x60			//LDA ($22),Y, STA $69, LDA $61, RTS
+	});
+	for(unsigned int y = 0; y <= 4; y++) cycles += Penalty(from, y);
+
+	m.WriteByte(0x22, r.a);
+	m.WriteByte(0x23, r.y);
+	b = m.ReadByte(from + 4u);
+	m.WriteByte(0x6D, b);
+	b = m.ReadByte(from + 3u);
+	m.WriteByte(0x6C, b);
+	b = m.ReadByte(from + 2u);
+	m.WriteByte(0x6B, b);
+	b = m.ReadByte(from + 1u);
+	m.WriteByte(0x6E, b);
+	m.WriteByte(0x6F, b ^ m.ReadByte(0x66));
+	m.WriteByte(0x6A, m.ReadByte(0x6E) | 0x80u);
+	b = m.ReadByte(from);
+	m.WriteByte(0x69, b);
+	b = m.ReadByte(0x61);
+
+	r.a = b;
+	r.y = 0;
+	cpu.SetNZ(b);
+	cpu.ReturnFromHook();
+	return true;
+}
+
+//$BBFC MOVEF: copies ARG to FAC
+static bool MOVEF(C64Machine &cpu, unsigned int &cycles)
+{
+	if(!Banked(cpu)) return false;
+	C64Memory &m = cpu.memory;
+	C64Machine::Registers &r = cpu.registers;
+
+	cycles =
+		Cycles({0xA5, 0x85, 0xA2}) +			//LDA $6E, STA $66, LDX #5
+		Cycles({0xB5, 0x95, 0xCA, 0xD0}) * 5 +	//LDA $68,X, STA $60,X, DEX, BNE
+		4 +										//BNE taken four times
+		Cycles({0x86, 0x60});					//STX $70, RTS
+
+	m.WriteByte(0x66, m.ReadByte(0x6E));
+	for(uint8_t x = 5; x > 0; x--){
+		r.a = m.ReadByte(0x68u + x);
+		m.WriteByte(0x60u + x, r.a);
+	}
+	m.WriteByte(0x70, 0);
+
+	r.x = 0;
+	cpu.SetNZ(0);
+	cpu.ReturnFromHook();
+	return true;
+}
+
+//$BBD4 MOVMF: rounds FAC (JSR $BC1B) and stores it at X/Y. A carry out
+//of the mantissa makes the ROM renormalise, which is left to it.
+static bool MOVMF(C64Machine &cpu, unsigned int &cycles)
+{
+	if(!Banked(cpu)) return false;
+	C64Memory &m = cpu.memory;
+	C64Machine::Registers &r = cpu.registers;
+	uint8_t b;
+
+	uint8_t exp = m.ReadByte(0x61);
+	uint8_t rounding = m.ReadByte(0x70);
+	if(
+		exp != 0 && (rounding & 0x80u) &&
+		m.ReadByte(0x62) == 0xFF && m.ReadByte(0x63) == 0xFF &&
+		m.ReadByte(0x64) == 0xFF && m.ReadByte(0x65) == 0xFF
+	){
+		return false;
+	}
+
+	//$BC1B ROUND
+	PushedReturn(cpu, 0, 0xBBD4);
+	cycles = Cycles({0x20, 0xA5, 0xF0});				//JSR $BC1B, LDA $61, BEQ
+	if(exp == 0){
+		cycles += 1;									//BEQ taken
+	}
+	else{
+		cycles += Cycles({0x06, 0x90});					//ASL $70, BCC
+		m.WriteByte(0x70, rounding << 1u);
+		r.p &= ~Flags::Carry;
+		if(rounding & 0x80u){
+			r.p |= Flags::Carry;
+			//$B96F, increments the mantissa from its low byte up
+			PushedReturn(cpu, 1, 0xBC23);
+			cycles += Cycles({0x20});					//JSR $B96F
+			for(uint8_t addr = 0x65; addr >= 0x62; addr--){
+				b = m.ReadByte(addr) + 1u;
+				m.WriteByte(addr, b);
+				cycles += Cycles({0xE6});				//INC
+				if(addr == 0x62) break;
+				cycles += Cycles({0xD0});				//BNE
+				if(b != 0){
+					cycles += 1;						//BNE taken
+					break;
+				}
+			}
+			cycles += Cycles({0x60, 0xD0}) + 1;			//RTS, BNE taken
+		}
+		else{
+			cycles += 1;								//BCC taken
+		}
+	}
+	cycles += Cycles({0x60});							//RTS
+
+	cycles += Cycles({
+		0x86, 0x84, 0xA0,								//STX $22, STY $23, LDY #4
+		0xA5, 0x91, 0x88,								//LDA $65, STA ($22),Y, DEY
+		0xA5, 0x91, 0x88,								//LDA $64, STA ($22),Y, DEY
+		0xA5, 0x91, 0x88,								//LDA $63, STA ($22),Y, DEY
+		0xA5, 0x09, 0x25, 0x91, 0x88,					//LDA $66, ORA #$7F, AND $62, STA ($22),Y, DEY
+		0xA5, 0x91, 0x84, 0x60							//LDA $61, STA ($22),Y, STY $70, RTS
+	});
+
+	m.WriteByte(0x22, r.x);
+	m.WriteByte(0x23, r.y);
+	StoreIndirect(m, 4, m.ReadByte(0x65));
+	StoreIndirect(m, 3, m.ReadByte(0x64));
+	StoreIndirect(m, 2, m.ReadByte(0x63));
+	StoreIndirect(m, 1, (m.ReadByte(0x66) | 0x7Fu) & m.ReadByte(0x62));
+	b = m.ReadByte(0x61);
+	StoreIndirect(m, 0, b);
+	m.WriteByte(0x70, 0);
+
+	r.a = b;
+	r.y = 0;
+	cpu.SetNZ(b);
+	cpu.ReturnFromHook();
+	return true;
+}
+
+//Runs the native routine on a copy of the machine, then interprets the
+//ROM routine on the real one up to its RTS, and compares the two
+template<C64Machine::Hook NATIVE>
+static bool Verified(C64Machine &cpu, unsigned int &cycles)
+{
+	static thread_local C64Memory mem;
+	mem = cpu.memory;
+	C64Machine native(mem);
+	native.registers = cpu.registers;
+	unsigned int nativeCycles = 0;
+	bool handled = NATIVE(native, nativeCycles);
+
+	uint16_t pc = cpu.registers.pc;
+	uint8_t s = cpu.registers.s + 2u;
+	cycles = 0;
+	do{
+		cycles += cpu.DoStep();
+	}while(cpu.registers.s != s);
+
+	if(!handled) return true;
+
+	cpu.SyncFlags();
+	native.SyncFlags();
+	const C64Machine::Registers &a = cpu.registers, &b = native.registers;
+	if(
+		a.a != b.a || a.x != b.x || a.y != b.y || a.p != b.p || a.s != b.s || a.pc != b.pc ||
+		cycles != nativeCycles ||
+		std::memcmp(cpu.memory.ram, mem.ram, sizeof(mem.ram)) != 0
+	){
+		fprintf(stderr, "%04X:\tHook differs from ROM\n", pc);
+		fprintf(stderr, "\tROM:    A:%02X X:%02X Y:%02X P:%02X S:%02X PC:%04X %u cycles\n", a.a, a.x, a.y, a.p, a.s, a.pc, cycles);
+		fprintf(stderr, "\tnative: A:%02X X:%02X Y:%02X P:%02X S:%02X PC:%04X %u cycles\n", b.a, b.x, b.y, b.p, b.s, b.pc, nativeCycles);
+		for(size_t i = 0; i < sizeof(mem.ram); i++){
+			if(cpu.memory.ram[i] != mem.ram[i]) fprintf(stderr, "\t$%04X ROM:%02X native:%02X\n", (unsigned int) i, cpu.memory.ram[i], mem.ram[i]);
+		}
+		abort();
+	}
+	return true;
+}
+
+void InstallHooks(C64Machine &cpu, bool verify)
+{
+	cpu.SetHook(0xBBA2, verify ? Verified<MOVFM> : MOVFM);
+	cpu.SetHook(0xBBD4, verify ? Verified<MOVMF> : MOVMF);
+	cpu.SetHook(0xBA8C, verify ? Verified<CONUPK> : CONUPK);
+	cpu.SetHook(0xBBFC, verify ? Verified<MOVEF> : MOVEF);
+}
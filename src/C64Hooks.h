@@ -0,0 +1,11 @@
+#ifndef _C64HOOKS_H
+#define _C64HOOKS_H
+
+#include "C64Memory.h"
+
+//Native versions of the BASIC ROM routines that just move floats between
+//memory and FAC/ARG: MOVFM, MOVMF, CONUPK and MOVEF. With verify set,
+//every call also runs the ROM code, and aborts if the results differ.
+void InstallHooks(C64Machine &cpu, bool verify);
+
+#endif
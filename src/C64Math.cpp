@@ -0,0 +1,580 @@
+#include "C64Math.h"
+
+//Each function is one ROM routine, and the names and comments follow the
+//published disassemblies. The carry flag is kept in c as the ROM leaves
+//it, since some routines go on to use it.
+
+//Constants and series used by the functions, at their ROM addresses
+static const uint8_t CON_ONE[5] = {0x81, 0x00, 0x00, 0x00, 0x00};				//$B9BC
+static const uint8_t POLY_LOG[1 + 4 * 5] = {									//$B9C1
+	0x03,
+	0x7F, 0x5E, 0x56, 0xCB, 0x79,
+	0x80, 0x13, 0x9B, 0x0B, 0x64,
+	0x80, 0x76, 0x38, 0x93, 0x16,
+	0x82, 0x38, 0xAA, 0x3B, 0x20
+};
+static const uint8_t CON_SQR_HALF[5] = {0x80, 0x35, 0x04, 0xF3, 0x34};			//$B9D6
+static const uint8_t CON_SQR_TWO[5] = {0x81, 0x35, 0x04, 0xF3, 0x34};			//$B9DB
+static const uint8_t CON_NEG_HALF[5] = {0x80, 0x80, 0x00, 0x00, 0x00};			//$B9E0
+static const uint8_t CON_LOG_TWO[5] = {0x80, 0x31, 0x72, 0x17, 0xF8};			//$B9E5
+static const uint8_t CON_99999999_9[5] = {0x9B, 0x3E, 0xBC, 0x1F, 0xFD};		//$BDB3
+static const uint8_t CON_999999999[5] = {0x9E, 0x6E, 0x6B, 0x27, 0xFD};		//$BDB8
+static const uint8_t CON_BILLION[5] = {0x9E, 0x6E, 0x6B, 0x28, 0x00};			//$BDBD
+static const uint8_t CON_HALF[5] = {0x80, 0x00, 0x00, 0x00, 0x00};				//$BF11
+//Powers of ten, with alternating signs, for the digits of FOUT
+static const uint8_t DECTBL[9 * 4] = {											//$BF16
+	0xFA, 0x0A, 0x1F, 0x00,		//-100000000
+	0x00, 0x98, 0x96, 0x80,		//10000000
+	0xFF, 0xF0, 0xBD, 0xC0,		//-1000000
+	0x00, 0x01, 0x86, 0xA0,		//100000
+	0xFF, 0xFF, 0xD8, 0xF0,		//-10000
+	0x00, 0x00, 0x03, 0xE8,		//1000
+	0xFF, 0xFF, 0xFF, 0x9C,		//-100
+	0x00, 0x00, 0x00, 0x0A,		//10
+	0xFF, 0xFF, 0xFF, 0xFF		//-1
+};
+static const uint8_t CON_LOG_E[5] = {0x81, 0x38, 0xAA, 0x3B, 0x29};				//$BFBF
+static const uint8_t POLY_EXP[1 + 8 * 5] = {									//$BFC4
+	0x07,
+	0x71, 0x34, 0x58, 0x3E, 0x56,
+	0x74, 0x16, 0x7E, 0xB3, 0x1B,
+	0x77, 0x2F, 0xEE, 0xE3, 0x85,
+	0x7A, 0x1D, 0x84, 0x1C, 0x2A,
+	0x7C, 0x63, 0x59, 0x58, 0x0A,
+	0x7E, 0x75, 0xFD, 0xE7, 0xC6,
+	0x80, 0x31, 0x72, 0x18, 0x10,
+	0x81, 0x00, 0x00, 0x00, 0x00
+};
+static const uint8_t CON_PI_HALF[5] = {0x81, 0x49, 0x0F, 0xDA, 0xA2};			//$E2E0
+static const uint8_t CON_PI_DOUB[5] = {0x83, 0x49, 0x0F, 0xDA, 0xA2};			//$E2E5
+static const uint8_t QUARTER[5] = {0x7F, 0x00, 0x00, 0x00, 0x00};				//$E2EA
+static const uint8_t POLY_SIN[1 + 6 * 5] = {									//$E2EF
+	0x05,
+	0x84, 0xE6, 0x1A, 0x2D, 0x1B,
+	0x86, 0x28, 0x07, 0xFB, 0xF8,
+	0x87, 0x99, 0x68, 0x89, 0x01,
+	0x87, 0x23, 0x35, 0xDF, 0xE1,
+	0x86, 0xA5, 0x5D, 0xE7, 0x28,
+	0x83, 0x49, 0x0F, 0xDA, 0xA2
+};
+static const uint8_t POLY_ATN[1 + 12 * 5] = {									//$E33E
+	0x0B,
+	0x76, 0xB3, 0x83, 0xBD, 0xD3,
+	0x79, 0x1E, 0xF4, 0xA6, 0xF5,
+	0x7B, 0x83, 0xFC, 0xB0, 0x10,
+	0x7C, 0x0C, 0x1F, 0x67, 0xCA,
+	0x7C, 0xDE, 0x53, 0xCB, 0xC1,
+	0x7D, 0x14, 0x64, 0x70, 0x4C,
+	0x7D, 0xB7, 0xEA, 0x51, 0x7A,
+	0x7D, 0x63, 0x30, 0x88, 0x7E,
+	0x7E, 0x92, 0x44, 0x99, 0x3A,
+	0x7E, 0x4C, 0xCC, 0x91, 0xC7,
+	0x7F, 0xAA, 0xAA, 0xAA, 0x13,
+	0x81, 0x00, 0x00, 0x00, 0x00
+};
+
+//The ROM address of a series, stepping a pointer across a page boundary
+//between its terms leaves the carry set
+static uint16_t SeriesAddress(const uint8_t *poly)
+{
+	if(poly == POLY_LOG) return 0xB9C1;
+	if(poly == POLY_EXP) return 0xBFC4;
+	if(poly == POLY_SIN) return 0xE2EF;
+	return 0xE33E;
+}
+
+//$BA8C CONUPK: loads ARG from memory and sets the sign comparison byte
+void C64Math::CONUPK(const uint8_t *f)
+{
+	zp[ARG + 4] = f[4];
+	zp[ARG + 3] = f[3];
+	zp[ARG + 2] = f[2];
+	zp[ARGSIGN] = f[1];
+	zp[SGNCPR] = f[1] ^ zp[FACSIGN];
+	zp[ARG + 1] = f[1] | 0x80u;
+	zp[ARG] = f[0];
+}
+
+//$B97E OVERFLOW
+void C64Math::Overflow()
+{
+	throw Error{ERR_OVERFLOW};
+}
+
+//$B853 FSUBT: FAC = ARG - FAC
+void C64Math::FSUBT()
+{
+	zp[FACSIGN] = ~zp[FACSIGN];
+	zp[SGNCPR] = zp[FACSIGN] ^ zp[ARGSIGN];
+	FADDT();
+}
+
+//$BA59 MULTIPLY1: a zero byte of the multiplier just shifts RESULT right
+//by a byte. The extra SHIFT_RIGHT step shifts it a further bit when the
+//carry is clear, a bug of the original ROM.
+void C64Math::Multiply1(uint8_t a)
+{
+	if(a != 0){
+		Multiply2(a);
+		return;
+	}
+	ShiftRightBytes(RESULT - 1);
+	ShiftRight(a, RESULT - 1);
+}
+
+//$BA5E MULTIPLY2: adds ARG into RESULT for each set bit of a, shifting
+//RESULT right through the rounding byte after each
+void C64Math::Multiply2(uint8_t a)
+{
+	c = a & 1u;
+	a = (a >> 1) | 0x80u;
+	do{
+		if(c){
+			c = false;
+			for(unsigned int i = 3, j = 4; j >= 1; i--, j--){
+				unsigned int sum = zp[RESULT + i] + zp[ARG + j] + c;
+				zp[RESULT + i] = sum;
+				c = sum > 0xFFu;
+			}
+		}
+		for(unsigned int i = 0; i < 4; i++){
+			bool out = zp[RESULT + i] & 1u;
+			zp[RESULT + i] = (zp[RESULT + i] >> 1) | (c << 7);
+			c = out;
+		}
+		zp[FACEXTENSION] = (zp[FACEXTENSION] >> 1) | (c << 7);
+		c = a & 1u;
+		a >>= 1;
+	}while(a != 0);
+}
+
+//$BA2B FMULT: FAC = ARG * FAC
+void C64Math::FMULT()
+{
+	if(zp[FAC] == 0) return;
+	if(!AddExponents(zp[ARG])) return;
+	for(unsigned int i = 0; i < 4; i++) zp[RESULT + i] = 0;
+	Multiply1(zp[FACEXTENSION]);
+	Multiply1(zp[FAC + 4]);
+	Multiply1(zp[FAC + 3]);
+	Multiply1(zp[FAC + 2]);
+	Multiply2(zp[FAC + 1]);
+	CopyResultIntoFAC();
+}
+
+//$BC2B SIGN
+uint8_t C64Math::SIGN()
+{
+	if(zp[FAC] == 0) return 0;
+	return Sign2(zp[FACSIGN]);
+}
+
+//$BC33 SIGN2: $FF if the top bit of a is set, else 1
+uint8_t C64Math::Sign2(uint8_t a)
+{
+	c = a & 0x80u;
+	return c ? 0xFF : 0x01;
+}
+
+uint8_t C64Math::FCOMP(const uint8_t *f)
+{
+	uint8_t y;
+	return FCOMP(f, y);
+}
+
+//$BC5B FCOMP: 0 if FAC equals f, 1 if it is greater and $FF if smaller,
+//taking the rounding byte into account. y is left as the ROM leaves Y.
+uint8_t C64Math::FCOMP(const uint8_t *f, uint8_t &y)
+{
+	y = 1;
+	if(f[0] == 0) return SIGN();
+	if((f[1] ^ zp[FACSIGN]) & 0x80u) return Sign2(zp[FACSIGN]);
+	if(f[0] != zp[FAC]){
+		c = f[0] >= zp[FAC];
+	}
+	else if((f[1] | 0x80u) != zp[FAC + 1]){
+		c = (f[1] | 0x80u) >= zp[FAC + 1];
+	}
+	else{
+		for(y = 2; y <= 3; y++){
+			if(f[y] != zp[FAC + y]) break;
+		}
+		if(y <= 3){
+			c = f[y] >= zp[FAC + y];
+		}
+		else{
+			c = 0x7Fu >= zp[FACEXTENSION];
+			unsigned int diff = f[4] - zp[FAC + 4] - !c;
+			c = diff <= 0xFFu;
+			if((uint8_t) diff == 0) return 0;
+		}
+	}
+	uint8_t a = zp[FACSIGN];
+	if(c) a ^= 0xFFu;
+	return Sign2(a);
+}
+
+//$BC9B QINT: turns FAC into a 32 bit signed integer in FAC+1..FAC+4
+void C64Math::QINT()
+{
+	if(zp[FAC] == 0){
+		for(unsigned int i = 1; i <= 4; i++) zp[FAC + i] = 0;
+		return;
+	}
+	uint8_t a = zp[FAC] - 0xA0u;
+	c = zp[FAC] >= 0xA0u;
+	if(zp[FACSIGN] & 0x80u){
+		zp[SHIFTSIGNEXT] = 0xFF;
+		ComplementFACMantissa();
+	}
+	c = a >= 0xF9u;
+	if((uint8_t) (a - 0xF9u) & 0x80u){
+		ShiftRight(a, FAC);
+	}
+	else{
+		//QINT2, the first bit shifted in is the sign
+		uint8_t &top = zp[FAC + 1];
+		c = top & 1u;
+		top = (zp[FACSIGN] & 0x80u) | (top >> 1);
+		ShiftRightBits(top, FAC, a, false);
+	}
+	zp[SHIFTSIGNEXT] = 0;
+}
+
+//$BCCC INT: rounds FAC towards minus infinity
+void C64Math::INT()
+{
+	if(zp[FAC] >= 0xA0u){
+		c = true;
+		return;
+	}
+	QINT();
+	zp[FACEXTENSION] = 0;
+	uint8_t a = zp[FACSIGN];
+	zp[FACSIGN] = 0;
+	c = !(a & 0x80u);
+	zp[FAC] = 0xA0;
+	zp[CHARAC] = zp[FAC + 4];
+	NormalizeFAC1();
+}
+
+//$BAD4 OUTOFRNG: overflow if FAC is positive, else 0 in FAC, which ends
+//the calling routine
+void C64Math::OutOfRange()
+{
+	if(!(zp[FACSIGN] & 0x80u)) Overflow();
+	ZeroFAC();
+}
+
+//$E059 POLYNOMIAL: evaluates the series at poly for x = FAC, a count of
+//terms less one and then the coefficients, highest power first
+void C64Math::Polynomial(const uint8_t *poly)
+{
+	uint16_t addr = SeriesAddress(poly) + 1u;
+	MOVMF(zp + TEMP2);
+	zp[SERLEN] = poly[0];
+	const uint8_t *term = poly + 1;
+	FMUL(term);
+	for(;;){
+		c = (addr & 0xFFu) + 5u > 0xFFu;
+		addr += 5;
+		term += 5;
+		FADD(term);
+		if(--zp[SERLEN] == 0) return;
+		FMUL(zp + TEMP2);
+	}
+}
+
+//$E043 POLYNOMIAL_ODD: x * P(x^2) for the series at poly
+void C64Math::PolynomialOdd(const uint8_t *poly)
+{
+	MOVMF(zp + TEMP1);
+	FMUL(zp + TEMP1);
+	Polynomial(poly);
+	FMUL(zp + TEMP1);
+}
+
+//$BF71 SQR: FAC = FAC ^ 0.5
+void C64Math::SQR()
+{
+	MOVAF();
+	MOVFM(CON_HALF);
+	FPWRT();
+}
+
+//$BF7B FPWRT: FAC = ARG ^ FAC, as EXP(FAC * LOG(ARG)). A negative ARG
+//only works with a whole power, whose parity then gives the sign.
+void C64Math::FPWRT()
+{
+	if(zp[FAC] == 0){
+		EXP();
+		return;
+	}
+	if(zp[ARG] == 0){
+		zp[FAC] = 0;
+		zp[FACSIGN] = 0;
+		return;
+	}
+	MOVMF(zp + TEMP3);
+	uint8_t a = zp[ARGSIGN], y = 0;
+	if(a & 0x80u){
+		INT();
+		a = FCOMP(zp + TEMP3, y);
+		if(a == 0){
+			a = y;
+			y = zp[CHARAC];
+		}
+	}
+	//$BBFE, MOVEF with the sign in a
+	zp[FACSIGN] = a;
+	for(unsigned int i = 0; i < 5; i++) zp[FAC + i] = zp[ARG + i];
+	zp[FACEXTENSION] = 0;
+	uint8_t pushed = y;
+	LOG();
+	FMUL(zp + TEMP3);
+	EXP();
+	c = pushed & 1u;
+	if(c) NEGOP();
+}
+
+//$BFED EXP: splits FAC / LOG(2) into a whole part, added to the exponent,
+//and a fraction for the series
+void C64Math::EXP()
+{
+	FMUL(CON_LOG_E);
+	unsigned int sum = zp[FACEXTENSION] + 0x50u + c;
+	uint8_t a = sum;
+	c = sum > 0xFFu;
+	if(c && IncrementFACMantissa()) NormalizeFAC5();
+	zp[ARGEXTENSION] = a;
+	MOVFA();
+	c = zp[FAC] >= 0x88u;
+	if(c){
+		OutOfRange();
+		return;
+	}
+	INT();
+	sum = zp[CHARAC] + 0x81u;
+	a = sum;
+	c = sum > 0xFFu;
+	if(a == 0){
+		OutOfRange();
+		return;
+	}
+	a--;
+	c = true;
+	uint8_t pushed = a;
+	for(unsigned int i = 0; i < 6; i++){
+		uint8_t t = zp[ARG + i];
+		zp[ARG + i] = zp[FAC + i];
+		zp[FAC + i] = t;
+	}
+	zp[FACEXTENSION] = zp[ARGEXTENSION];
+	FSUBT();
+	NEGOP();
+	Polynomial(POLY_EXP);
+	zp[SGNCPR] = 0;
+	AddExponents(pushed);
+}
+
+//$B9EA LOG: from the exponent and a series for the mantissa, scaled to
+//the range SQR(0.5) to SQR(2)
+void C64Math::LOG()
+{
+	uint8_t sign = SIGN();
+	if(sign == 0 || (sign & 0x80u)) throw Error{ERR_ILLQUAN};
+	unsigned int diff = zp[FAC] - 0x7Fu - !c;
+	uint8_t pushed = diff;
+	c = diff <= 0xFFu;
+	zp[FAC] = 0x80;
+	FADD(CON_SQR_HALF);
+	FDIV(CON_SQR_TWO);
+	FSUB(CON_ONE);
+	PolynomialOdd(POLY_LOG);
+	FADD(CON_NEG_HALF);
+	ADDACC(pushed);
+	FMUL(CON_LOG_TWO);
+}
+
+//$E264 COS: SIN(FAC + PI / 2)
+void C64Math::COS()
+{
+	FADD(CON_PI_HALF);
+	SIN();
+}
+
+//$E26B SIN: reduces FAC to a fraction of a turn, then folds it into the
+//range of the series
+void C64Math::SIN()
+{
+	MOVAF();
+	DIV(CON_PI_DOUB, zp[ARGSIGN]);
+	MOVAF();
+	INT();
+	zp[SGNCPR] = 0;
+	FSUBT();
+	FSUB(QUARTER);
+	uint8_t pushed = zp[FACSIGN];
+	if(pushed & 0x80u){
+		FADD(CON_HALF);
+		if(zp[FACSIGN] & 0x80u){
+			SIN1(pushed, false);
+			return;
+		}
+		zp[CPRMASK] = ~zp[CPRMASK];
+	}
+	SIN1(pushed, true);
+}
+
+//$E29D: the end of SIN, also used by TAN. negate false enters at $E2A0.
+void C64Math::SIN1(uint8_t pushed, bool negate)
+{
+	if(negate) NEGOP();
+	FADD(QUARTER);
+	if(pushed & 0x80u) NEGOP();
+	PolynomialOdd(POLY_SIN);
+}
+
+//$E2B4 TAN: SIN(FAC) divided by the cosine, from the same reduction
+void C64Math::TAN()
+{
+	MOVMF(zp + TEMP1);
+	zp[CPRMASK] = 0;
+	SIN();
+	MOVMF(zp + TEMP3);
+	MOVFM(zp + TEMP1);
+	zp[FACSIGN] = 0;
+	SIN1(zp[CPRMASK], true);
+	FDIV(zp + TEMP3);
+}
+
+//$E30E ATN: works on 1 / FAC above 1, and takes the result from PI / 2
+void C64Math::ATN()
+{
+	uint8_t sign = zp[FACSIGN];
+	if(sign & 0x80u) NEGOP();
+	uint8_t exp = zp[FAC];
+	c = exp >= 0x81u;
+	if(c) FDIV(CON_ONE);
+	PolynomialOdd(POLY_ATN);
+	c = exp >= 0x81u;
+	if(c) FSUB(CON_PI_HALF);
+	if(sign & 0x80u) NEGOP();
+}
+
+//$BDDD FOUT: scales FAC to nine digits before the point, then writes them
+//by repeatedly adding powers of ten, with the point or an exponent. out
+//gets what the ROM writes from $0100, a space or minus sign first.
+void C64Math::FOUT(char *out)
+{
+	//The ROM writes at $00FF + y
+	char *stack2 = out - 1;
+	uint8_t y = 1, a, x;
+	a = (zp[FACSIGN] & 0x80u) ? '-' : ' ';
+	stack2[y] = a;
+	zp[FACSIGN] = a;
+	zp[STRNG2] = y;
+	y++;
+	if(zp[FAC] == 0){
+		stack2[y] = '0';
+		stack2[y + 1] = 0;
+		return;
+	}
+	a = 0;
+	if(zp[FAC] <= 0x80u){
+		FMUL(CON_BILLION);
+		a = -9;
+	}
+	zp[INDX] = a;
+
+big:
+	a = FCOMP(CON_999999999);
+	if(a == 0) goto rounded;
+	if(!(a & 0x80u)) goto smaller;
+small:
+	a = FCOMP(CON_99999999_9);
+	if(a != 0 && !(a & 0x80u)) goto round;
+	MUL10();
+	if(--zp[INDX] != 0) goto small;
+smaller:
+	DIV10();
+	if(++zp[INDX] != 0) goto big;
+round:
+	FADD(CON_HALF);
+rounded:
+	QINT();
+
+	//Where the point goes, or an exponent when it is out of reach
+	x = 1;
+	a = zp[INDX] + 10u;
+	if(!(a & 0x80u) && a < 11){
+		x = a - 1u;
+		a = 2;
+	}
+	a -= 2;
+	zp[EXPON] = a;
+	zp[INDX] = x;
+	if(x == 0 || (x & 0x80u)){
+		y = zp[STRNG2];
+		stack2[++y] = '.';
+		if(x != 0) stack2[++y] = '0';
+		zp[STRNG2] = y;
+	}
+
+	//Each digit counts the additions of a power of ten it takes for the
+	//sign of the mantissa to flip, the powers alternating in sign
+	y = 0;
+	x = 0x80;
+	do{
+		for(;;){
+			c = false;
+			for(unsigned int i = 4; i >= 1; i--){
+				unsigned int sum = zp[FAC + i] + DECTBL[y + i - 1u] + c;
+				zp[FAC + i] = sum;
+				c = sum > 0xFFu;
+			}
+			x++;
+			if(c != (bool) (x & 0x80u)) break;
+		}
+		a = x;
+		if(c){
+			unsigned int sum = (uint8_t) ~a + 0x0Au + 1u;
+			a = sum;
+			c = sum > 0xFFu;
+		}
+		a += 0x2Fu + c;
+		y += 4;
+		zp[VARPNT] = y;
+		y = zp[STRNG2];
+		y++;
+		x = a;
+		stack2[y] = a & 0x7Fu;
+		if(--zp[INDX] == 0) stack2[++y] = '.';
+		zp[STRNG2] = y;
+		y = zp[VARPNT];
+		x = ~x & 0x80u;
+	}while(y != sizeof(DECTBL));
+
+	//Trailing zeroes go, and the point if nothing follows it
+	y = zp[STRNG2];
+	do{
+		a = stack2[y--];
+	}while(a == '0');
+	if(a != '.') y++;
+
+	x = zp[EXPON];
+	if(x == 0){
+		stack2[y + 1] = 0;
+		return;
+	}
+	a = '+';
+	if(x & 0x80u){
+		x = -zp[EXPON];
+		a = '-';
+	}
+	stack2[y + 2] = a;
+	stack2[y + 1] = 'E';
+	stack2[y + 3] = '0' + x / 10u;
+	stack2[y + 4] = '0' + x % 10u;
+	stack2[y + 5] = 0;
+}
@@ -0,0 +1,662 @@
+#ifndef _C64MATH_H
+#define _C64MATH_H
+
+#include <stdint.h>
+
+//Native port of the BASIC ROM floating point routines. They work on a
+//copy of the zero page locations the ROM uses, follow its code step by
+//step, and so give results byte-identical to running it.
+class C64Math
+{
+	public:
+	//Zero page locations, as used by the ROM
+	enum
+	{
+		CHARAC = 0x07,			//Low byte of the last INT
+		CPRMASK = 0x12,			//Sign flips of TAN
+		DEST = 0x24,
+		RESULT = 0x26,			//Product/quotient, 4 bytes
+		VARPNT = 0x47,			//Position in the table of powers of ten
+		TEMP3 = 0x4E,
+		ARGEXTENSION = 0x56,	//Rounding byte of ARG while adding
+		TEMP1 = 0x57,
+		TEMP2 = 0x5C,
+		INDX = 0x5D,			//Digits after the point/digits before it
+		EXPON = 0x5E,			//Decimal exponent
+		DPFLG = 0x5F,			//Point seen
+		EXPSGN = 0x60,			//Exponent is negative
+		FAC = 0x61,				//Exponent, then 4 mantissa bytes
+		FACSIGN = 0x66,
+		SERLEN = 0x67,			//Terms left in a polynomial, sign of FIN
+		SHIFTSIGNEXT = 0x68,	//Shifted into the top by whole-byte shifts
+		ARG = 0x69,
+		ARGSIGN = 0x6E,
+		SGNCPR = 0x6F,			//Sign of FAC EOR sign of ARG
+		FACEXTENSION = 0x70,	//Rounding byte of FAC
+		STRNG2 = 0x71			//Length of the text FOUT has written
+	};
+
+	//Thrown where the ROM would report an error
+	struct Error
+	{
+		int code;
+	};
+	enum
+	{
+		ERR_ILLQUAN = 14,
+		ERR_OVERFLOW = 15,
+		ERR_ZERODIV = 20
+	};
+
+	uint8_t zp[0x100];
+	bool c;		//Carry flag, some routines use the one left by the last
+
+	constexpr C64Math() : zp{}, c(false), txtptr(nullptr)
+	{
+	}
+
+	constexpr void MOVFM(const uint8_t *f);			//$BBA2
+	void CONUPK(const uint8_t *f);					//$BA8C
+	constexpr void MOVMF(uint8_t *f);				//$BBD4
+	constexpr void MOVEF();							//$BBFC
+	constexpr void MOVFA();							//$BC0F
+	constexpr void MOVAF();							//$BC0C, rounds FAC first
+	constexpr void ROUND();							//$BC1B
+
+	void FADD(const uint8_t *f){ CONUPK(f); FADDT(); }	//$B867
+	void FSUB(const uint8_t *f){ CONUPK(f); FSUBT(); }	//$B850
+	void FMUL(const uint8_t *f){ CONUPK(f); FMULT(); }	//$BA28
+	void FDIV(const uint8_t *f){ CONUPK(f); FDIVT(); }	//$BB0F
+
+	constexpr void FADDT();							//FAC = ARG + FAC
+	void FSUBT();									//FAC = ARG - FAC
+	void FMULT();									//FAC = ARG * FAC
+	constexpr void FDIVT();							//FAC = ARG / FAC
+
+	uint8_t SIGN();									//$BC2B, 0, 1 or $FF
+	uint8_t FCOMP(const uint8_t *f);				//$BC5B, sign of FAC - f
+	constexpr void NEGOP();							//$BFB4
+	void INT();										//$BCCC
+	void QINT();									//$BC9B
+
+	void SQR();										//$BF71
+	void FPWRT();									//$BF7B, FAC = ARG ^ FAC
+	void EXP();										//$BFED
+	void LOG();										//$B9EA
+	void COS();										//$E264
+	void SIN();										//$E26B
+	void TAN();										//$E2B4
+	void ATN();										//$E30E
+
+	constexpr void FIN(const char *str);			//$BCF3, FAC = the number str starts with
+	void FOUT(char *out);							//$BDDD, out needs 20 bytes
+
+	private:
+	static constexpr uint8_t CON_TEN[5] = {0x84, 0x20, 0x00, 0x00, 0x00};	//$BAF9
+	
+	const char *txtptr;					//Where CHRGET reads, $7A
+
+	constexpr uint8_t CHRGET();
+	constexpr uint8_t CHRGOT();
+
+	constexpr void ZeroFAC();
+	constexpr void NormalizeFAC1();
+	constexpr void NormalizeFAC2();
+	constexpr void NormalizeFAC5();
+	constexpr void ComplementFAC();
+	constexpr void ComplementFACMantissa();
+	constexpr bool IncrementFACMantissa();
+	void Overflow();
+
+	constexpr void ShiftRightBytes(uint8_t x);
+	constexpr uint8_t ShiftRight(uint8_t a, uint8_t x);
+	constexpr uint8_t ShiftRightBits(uint8_t a, uint8_t x, uint8_t y, bool first);
+
+	constexpr void FADD2(uint8_t a, uint8_t x);
+	constexpr bool AddExponents(uint8_t a);
+	void Multiply1(uint8_t a);
+	void Multiply2(uint8_t a);
+	constexpr void CopyResultIntoFAC();
+
+	uint8_t Sign2(uint8_t a);
+	uint8_t FCOMP(const uint8_t *f, uint8_t &y);
+	constexpr void FLOAT(uint8_t a);
+	constexpr void ADDACC(uint8_t a);
+	constexpr void DIV(const uint8_t *f, uint8_t x);
+	constexpr void MUL10();
+	constexpr void DIV10();
+	void OutOfRange();
+	void Polynomial(const uint8_t *poly);
+	void PolynomialOdd(const uint8_t *poly);
+	void SIN1(uint8_t pushed, bool negate);
+};
+
+//The routines FIN needs are constexpr, so that literals are parsed at
+//compile time, and defined here for that
+
+//$BBA2 MOVFM: loads FAC from memory
+constexpr void C64Math::MOVFM(const uint8_t *f)
+{
+	zp[FAC + 4] = f[4];
+	zp[FAC + 3] = f[3];
+	zp[FAC + 2] = f[2];
+	zp[FACSIGN] = f[1];
+	zp[FAC + 1] = f[1] | 0x80u;
+	zp[FAC] = f[0];
+	zp[FACEXTENSION] = 0;
+}
+
+//$BBD4 MOVMF: rounds FAC and stores it to memory
+constexpr void C64Math::MOVMF(uint8_t *f)
+{
+	ROUND();
+	f[4] = zp[FAC + 4];
+	f[3] = zp[FAC + 3];
+	f[2] = zp[FAC + 2];
+	f[1] = (zp[FACSIGN] | 0x7Fu) & zp[FAC + 1];
+	f[0] = zp[FAC];
+	zp[FACEXTENSION] = 0;
+}
+
+//$BBFC MOVEF: copies ARG to FAC
+constexpr void C64Math::MOVEF()
+{
+	zp[FACSIGN] = zp[ARGSIGN];
+	for(unsigned int i = 0; i < 5; i++) zp[FAC + i] = zp[ARG + i];
+	zp[FACEXTENSION] = 0;
+}
+
+//$BC0F MOVFA: copies FAC to ARG
+constexpr void C64Math::MOVFA()
+{
+	for(unsigned int i = 0; i < 6; i++) zp[ARG + i] = zp[FAC + i];
+	zp[FACEXTENSION] = 0;
+}
+
+//$BC0C: rounds FAC and copies it to ARG
+constexpr void C64Math::MOVAF()
+{
+	ROUND();
+	MOVFA();
+}
+
+//$BC1B ROUND: adds the top bit of the rounding byte to the mantissa
+constexpr void C64Math::ROUND()
+{
+	if(zp[FAC] == 0) return;
+	c = zp[FACEXTENSION] & 0x80u;
+	zp[FACEXTENSION] <<= 1;
+	if(!c) return;
+	if(IncrementFACMantissa()) NormalizeFAC5();
+}
+
+//$B8F7 ZERO_FAC
+constexpr void C64Math::ZeroFAC()
+{
+	zp[FAC] = 0;
+	zp[FACSIGN] = 0;
+}
+
+//$B8D2 NORMALIZE_FAC1: a clear carry means the subtraction went negative
+constexpr void C64Math::NormalizeFAC1()
+{
+	if(!c) ComplementFAC();
+	NormalizeFAC2();
+}
+
+//$B8D7 NORMALIZE_FAC2: shifts the mantissa left until its top bit is set,
+//first by whole bytes, lowering the exponent to match
+constexpr void C64Math::NormalizeFAC2()
+{
+	uint8_t a = 0;
+	c = false;
+	while(zp[FAC + 1] == 0){
+		zp[FAC + 1] = zp[FAC + 2];
+		zp[FAC + 2] = zp[FAC + 3];
+		zp[FAC + 3] = zp[FAC + 4];
+		zp[FAC + 4] = zp[FACEXTENSION];
+		zp[FACEXTENSION] = 0;
+		a += 8;
+		if(a == 0x20){
+			c = true;
+			ZeroFAC();
+			return;
+		}
+	}
+	//NORMALIZE_FAC3
+	while(!(zp[FAC + 1] & 0x80u)){
+		a++;
+		c = zp[FACEXTENSION] & 0x80u;
+		zp[FACEXTENSION] <<= 1;
+		for(unsigned int i = 4; i >= 1; i--){
+			bool out = zp[FAC + i] & 0x80u;
+			zp[FAC + i] = (zp[FAC + i] << 1) | c;
+			c = out;
+		}
+	}
+	//NORMALIZE_FAC4
+	if(a >= zp[FAC]){
+		c = true;
+		ZeroFAC();
+		return;
+	}
+	zp[FAC] -= a;
+	c = false;
+}
+
+//$B936 NORMALIZE_FAC5: a carry out of the mantissa shifts it back right
+//one bit into a higher exponent (NORMALIZE_FAC6)
+constexpr void C64Math::NormalizeFAC5()
+{
+	if(!c) return;
+	zp[FAC]++;
+	if(zp[FAC] == 0) Overflow();
+	for(unsigned int i = 1; i <= 4; i++){
+		bool out = zp[FAC + i] & 1u;
+		zp[FAC + i] = (zp[FAC + i] >> 1) | (c << 7);
+		c = out;
+	}
+	bool out = zp[FACEXTENSION] & 1u;
+	zp[FACEXTENSION] = (zp[FACEXTENSION] >> 1) | (c << 7);
+	c = out;
+}
+
+//$B947 COMPLEMENT_FAC
+constexpr void C64Math::ComplementFAC()
+{
+	zp[FACSIGN] = ~zp[FACSIGN];
+	ComplementFACMantissa();
+}
+
+//$B94D COMPLEMENT_FAC_MANTISSA: two's complement of the mantissa and
+//rounding byte
+constexpr void C64Math::ComplementFACMantissa()
+{
+	for(unsigned int i = 1; i <= 4; i++) zp[FAC + i] = ~zp[FAC + i];
+	zp[FACEXTENSION] = ~zp[FACEXTENSION];
+	zp[FACEXTENSION]++;
+	if(zp[FACEXTENSION] != 0) return;
+	IncrementFACMantissa();
+}
+
+//$B96F INCREMENT_FAC_MANTISSA. Returns true when it wraps to 0.
+constexpr bool C64Math::IncrementFACMantissa()
+{
+	for(unsigned int i = 4; i >= 1; i--){
+		if(++zp[FAC + i] != 0) return false;
+	}
+	return true;
+}
+
+//$B985 SHIFT_RIGHT2: shifts the mantissa at x+1 right by a byte, through
+//the rounding byte, with SHIFTSIGNEXT coming in at the top
+constexpr void C64Math::ShiftRightBytes(uint8_t x)
+{
+	zp[FACEXTENSION] = zp[(uint8_t) (x + 4u)];
+	zp[(uint8_t) (x + 4u)] = zp[(uint8_t) (x + 3u)];
+	zp[(uint8_t) (x + 3u)] = zp[(uint8_t) (x + 2u)];
+	zp[(uint8_t) (x + 2u)] = zp[(uint8_t) (x + 1u)];
+	zp[(uint8_t) (x + 1u)] = zp[SHIFTSIGNEXT];
+}
+
+//$B999 SHIFT_RIGHT: shifts the mantissa at x+1 right by -a bits, whole
+//bytes first. Returns the rounding byte with the bits shifted out.
+constexpr uint8_t C64Math::ShiftRight(uint8_t a, uint8_t x)
+{
+	for(;;){
+		unsigned int sum = a + 8u + c;
+		a = sum;
+		c = sum > 0xFFu;
+		if(a != 0 && !(a & 0x80u)) break;
+		ShiftRightBytes(x);
+	}
+	unsigned int diff = a - 8u - !c;
+	c = diff <= 0xFFu;
+	uint8_t y = diff;
+	a = zp[FACEXTENSION];
+	if(c){
+		c = false;
+		return a;
+	}
+	return ShiftRightBits(a, x, y, true);
+}
+
+//$B9A6 SHIFT_RIGHT3: shifts the mantissa at x+1 and a right by -y bits,
+//keeping the sign of the top byte. With first false, starts at
+//SHIFT_RIGHT4, halfway through the first shift with the carry in c.
+constexpr uint8_t C64Math::ShiftRightBits(uint8_t a, uint8_t x, uint8_t y, bool first)
+{
+	do{
+		if(first){
+			uint8_t &top = zp[(uint8_t) (x + 1u)];
+			c = top & 1u;
+			top = (top & 0x80u) | (top >> 1);
+		}
+		first = true;
+		for(unsigned int i = 2; i <= 4; i++){
+			uint8_t &b = zp[(uint8_t) (x + i)];
+			bool out = b & 1u;
+			b = (b >> 1) | (c << 7);
+			c = out;
+		}
+		a = (a >> 1) | (c << 7);
+		y++;
+	}while(y != 0);
+	c = false;
+	return a;
+}
+
+//$B86A FADDT: FAC = ARG + FAC
+constexpr void C64Math::FADDT()
+{
+	if(zp[FAC] == 0){
+		MOVEF();
+		return;
+	}
+	zp[ARGEXTENSION] = zp[FACEXTENSION];
+	FADD2(zp[ARG], ARG);
+}
+
+//$B877 FADD2: the addition proper, with a the exponent of ARG and x the
+//operand to shift when it is the smaller
+constexpr void C64Math::FADD2(uint8_t a, uint8_t x)
+{
+	if(a == 0) return;
+	uint8_t exp = a;
+	c = a >= zp[FAC];
+	a -= zp[FAC];
+	if(a != 0){
+		if(!c){
+			zp[FACEXTENSION] = 0;
+		}
+		else{
+			//ARG has the larger exponent, so FAC gets shifted instead
+			zp[FAC] = exp;
+			zp[FACSIGN] = zp[ARGSIGN];
+			a = -a;
+			zp[ARGEXTENSION] = 0;
+			x = FAC;
+		}
+		c = a >= 0xF9u;
+		if((uint8_t) (a - 0xF9u) & 0x80u){
+			//FADD1
+			a = ShiftRight(a, x);
+		}
+		else{
+			uint8_t y = a;
+			a = zp[FACEXTENSION];
+			uint8_t &top = zp[(uint8_t) (x + 1u)];
+			c = top & 1u;
+			top >>= 1;
+			a = ShiftRightBits(a, x, y, false);
+		}
+	}
+
+	//FADD3
+	if(zp[SGNCPR] & 0x80u){
+		uint8_t y = x == ARG ? FAC : ARG;
+		unsigned int sum = (uint8_t) ~a + zp[ARGEXTENSION] + 1u;
+		zp[FACEXTENSION] = sum;
+		c = sum > 0xFFu;
+		for(unsigned int i = 4; i >= 1; i--){
+			unsigned int diff = zp[y + i] - zp[x + i] - !c;
+			zp[FAC + i] = diff;
+			c = diff <= 0xFFu;
+		}
+		NormalizeFAC1();
+		return;
+	}
+
+	//FADD4
+	unsigned int sum = a + zp[ARGEXTENSION] + c;
+	zp[FACEXTENSION] = sum;
+	c = sum > 0xFFu;
+	for(unsigned int i = 4; i >= 1; i--){
+		sum = zp[FAC + i] + zp[ARG + i] + c;
+		zp[FAC + i] = sum;
+		c = sum > 0xFFu;
+	}
+	NormalizeFAC5();
+}
+
+//$BAB9 ADD_EXPONENTS1: adds the exponent a to that of FAC, for multiplying
+//and dividing. Returns false if the result underflowed, which leaves 0 in
+//FAC and ends the calling routine.
+constexpr bool C64Math::AddExponents(uint8_t a)
+{
+	if(a == 0){
+		ZeroFAC();
+		return false;
+	}
+	unsigned int sum = a + zp[FAC];
+	a = sum;
+	c = false;
+	if(sum > 0xFFu){
+		if(a & 0x80u) Overflow();
+	}
+	else if(!(a & 0x80u)){
+		ZeroFAC();
+		return false;
+	}
+	sum = a + 0x80u;
+	a = sum;
+	c = sum > 0xFFu;
+	zp[FAC] = a;
+	zp[FACSIGN] = a == 0 ? 0 : zp[SGNCPR];
+	return true;
+}
+
+//$BB8F COPY_RESULT_INTO_FAC
+constexpr void C64Math::CopyResultIntoFAC()
+{
+	for(unsigned int i = 0; i < 4; i++) zp[FAC + 1 + i] = zp[RESULT + i];
+	NormalizeFAC2();
+}
+
+//$BB12 FDIVT: FAC = ARG / FAC, by shift and subtract, one quotient bit
+//per step. The two bits after the last RESULT byte go to the rounding byte.
+constexpr void C64Math::FDIVT()
+{
+	if(zp[FAC] == 0) throw Error{ERR_ZERODIV};
+	ROUND();
+	c = false;
+	zp[FAC] = -zp[FAC];
+	if(!AddExponents(zp[ARG])) return;
+	zp[FAC]++;
+	if(zp[FAC] == 0) Overflow();
+
+	uint8_t x = 0xFC, a = 1;
+	bool compare = true;
+	for(;;){
+		if(compare){
+			c = true;
+			for(unsigned int i = 1; i <= 4; i++){
+				if(zp[ARG + i] != zp[FAC + i]){
+					c = zp[ARG + i] > zp[FAC + i];
+					break;
+				}
+			}
+		}
+		bool pushed = c;
+		bool out = a & 0x80u;
+		a = (a << 1) | c;
+		c = out;
+		if(c){
+			x++;
+			zp[(uint8_t) (RESULT + 3u + x)] = a;
+			if(x == 0){
+				a = 0x40;
+			}
+			else if(!(x & 0x80u)){
+				zp[FACEXTENSION] = a << 6;
+				CopyResultIntoFAC();
+				return;
+			}
+			else{
+				a = 1;
+			}
+		}
+		c = pushed;
+		if(c){
+			for(unsigned int i = 4; i >= 1; i--){
+				unsigned int diff = zp[ARG + i] - zp[FAC + i] - !c;
+				zp[ARG + i] = diff;
+				c = diff <= 0xFFu;
+			}
+		}
+		c = false;
+		for(unsigned int i = 4; i >= 1; i--){
+			out = zp[ARG + i] & 0x80u;
+			zp[ARG + i] = (zp[ARG + i] << 1) | c;
+			c = out;
+		}
+		//With a carry out of ARG the next bit is 1 without comparing
+		compare = !c && (zp[ARG + 1] & 0x80u);
+	}
+}
+
+//$BFB4 NEGOP
+constexpr void C64Math::NEGOP()
+{
+	if(zp[FAC] == 0) return;
+	zp[FACSIGN] = ~zp[FACSIGN];
+}
+
+//$BC3C FLOAT: FAC = the signed byte a
+constexpr void C64Math::FLOAT(uint8_t a)
+{
+	zp[FAC + 1] = a;
+	zp[FAC + 2] = 0;
+	c = !(a & 0x80u);
+	zp[FAC + 4] = 0;
+	zp[FAC + 3] = 0;
+	zp[FAC] = 0x88;
+	zp[FACEXTENSION] = 0;
+	zp[FACSIGN] = 0;
+	NormalizeFAC1();
+}
+
+//$BD7E ADDACC: FAC = FAC + the signed byte a
+constexpr void C64Math::ADDACC(uint8_t a)
+{
+	MOVAF();
+	FLOAT(a);
+	zp[SGNCPR] = zp[ARGSIGN] ^ zp[FACSIGN];
+	FADDT();
+}
+
+//$BB07 DIV: FAC = ARG / f, with x as the sign comparison byte
+constexpr void C64Math::DIV(const uint8_t *f, uint8_t x)
+{
+	zp[SGNCPR] = x;
+	MOVFM(f);
+	FDIVT();
+}
+
+//$BAE2 MUL10: FAC = FAC * 10, as FAC * 4 + FAC doubled
+constexpr void C64Math::MUL10()
+{
+	MOVAF();
+	uint8_t a = zp[FAC];
+	if(a == 0) return;
+	if(a + 2u > 0xFFu) Overflow();
+	zp[SGNCPR] = 0;
+	FADD2(a + 2u, 0);
+	if(++zp[FAC] == 0) Overflow();
+}
+
+//$BAFE DIV10: FAC = FAC / 10
+constexpr void C64Math::DIV10()
+{
+	MOVAF();
+	DIV(CON_TEN, 0);
+}
+
+//$0073 CHRGET: the next character of the text, skipping spaces. The carry
+//is clear for a digit.
+constexpr uint8_t C64Math::CHRGET()
+{
+	txtptr++;
+	return CHRGOT();
+}
+
+//$0079 CHRGOT: the character CHRGET returned last
+constexpr uint8_t C64Math::CHRGOT()
+{
+	while(*txtptr == ' ') txtptr++;
+	uint8_t a = *txtptr;
+	c = a >= 0x3Au || a < 0x30u;
+	return a;
+}
+
+//$BCF3 FIN: reads digits into FAC as a whole number, counting those after
+//the point, then scales it by ten for them and the exponent. str is read
+//as TXTPTR would be after CHRGOT.
+constexpr void C64Math::FIN(const char *str)
+{
+	txtptr = str;
+	uint8_t a = CHRGOT();
+	for(unsigned int i = INDX; i <= SERLEN; i++) zp[i] = 0;
+	if(c && a == '-'){
+		zp[SERLEN] = 0xFF;
+		a = CHRGET();
+	}
+	else if(c && a == '+'){
+		a = CHRGET();
+	}
+
+	//Digits, and one point among them
+	for(;;){
+		if(!c){
+			if(zp[DPFLG] & 0x80u) zp[INDX]++;
+			MUL10();
+			ADDACC(a - 0x30u);
+		}
+		else{
+			if(a != '.') break;
+			zp[DPFLG] = 0x80u | (zp[DPFLG] >> 1);
+			if(zp[DPFLG] & 0x40u) break;
+		}
+		a = CHRGET();
+	}
+
+	if(a == 'E'){
+		a = CHRGET();
+		if(c){
+			if(a == 0xAB || a == '-'){
+				zp[EXPSGN] = 0x80u | (zp[EXPSGN] >> 1);
+				a = CHRGET();
+			}
+			else if(a == 0xAA || a == '+'){
+				a = CHRGET();
+			}
+		}
+		//GETEXP, past two digits only the sign matters
+		while(!c){
+			if(zp[EXPON] >= 10){
+				if(!(zp[EXPSGN] & 0x80u)) Overflow();
+				zp[EXPON] = 100;
+			}
+			else{
+				zp[EXPON] = zp[EXPON] * 10u + (uint8_t) *txtptr - 0x30u;
+			}
+			a = CHRGET();
+		}
+	}
+
+	a = (zp[EXPSGN] & 0x80u) ? -zp[EXPON] : zp[EXPON];
+	zp[EXPON] = a - zp[INDX];
+	if(zp[EXPON] & 0x80u){
+		do{
+			DIV10();
+		}while(++zp[EXPON] != 0);
+	}
+	else if(zp[EXPON] != 0){
+		do{
+			MUL10();
+		}while(--zp[EXPON] != 0);
+	}
+	if(zp[SERLEN] & 0x80u) NEGOP();
+}
+
+#endif
@@ -0,0 +1,4 @@
+#include "C64Memory.h"
+#include "6502_impl.h"
+
+template class MachineT<C64Memory>;
@@ -1,6 +1,10 @@
+#ifndef _C64MEMORY_H
+#define _C64MEMORY_H
+
 #include "6502.h"
 
 #include <cstdio>
+#include <cstring>
 
 class C64Memory : public Memory
 {
@@ -8,26 +12,63 @@ class C64Memory : public Memory
 	uint8_t ram[64 * 1024];
 	static const uint8_t rom_kernal[8 * 1024];
 	static const uint8_t rom_basic[8 * 1024];
+	
+	//Per-page read and write pointers. ROM overlays RAM for reads only,
+	//writes always land in the RAM underneath.
+	const uint8_t *readPages[256];
+	uint8_t *writePages[256];
+	bool basicIn, kernalIn;
+	
 	virtual MemoryByte operator[](std::size_t address)
 	{
 		MemoryByte mb(this);
+		uint8_t page = address >> 8, offset = address & 0xFFu;
 		mb.addr = address;
-		mb.wptr = ram + address;
-		mb.ptr = ram + address;
-		
-		switch(address){
-			case 0xA000 ... 0xBFFF:
-				mb.ptr = rom_basic + address - 0xA000;
-				break;
-			case 0xE000 ... 0xFFFF:
-				mb.ptr = rom_kernal + address - 0xE000;
-				break;
-			default:
-				break;
-		}
+		mb.wptr = writePages[page] + offset;
+		mb.ptr = readPages[page] + offset;
 		return mb;
 	}
 	
+	//Hide Memory::ReadByte/WriteByte so C64Machine accesses the pages
+	//directly; the Read/Write hooks are empty for C64Memory anyway
+	uint8_t ReadByte(uint16_t address)
+	{
+		return readPages[address >> 8][address & 0xFFu];
+	}
+	
+	void WriteByte(uint16_t address, uint8_t value)
+	{
+		writePages[address >> 8][address & 0xFFu] = value;
+	}
+	
+	const uint8_t *ImmutablePage(uint8_t page)
+	{
+		return readPages[page] != writePages[page] ? readPages[page] : 0;
+	}
+	
+	//Selects which ROMs are visible at $A000-$BFFF and $E000-$FFFF, akin to
+	//the LORAM/HIRAM lines of the processor port. Banking BASIC out frees
+	//its 8 KB of RAM for data.
+	void SetBanking(bool basic, bool kernal)
+	{
+		basicIn = basic;
+		kernalIn = kernal;
+		for(size_t page = 0; page < 256; page++){
+			readPages[page] = ram + (page << 8);
+			writePages[page] = ram + (page << 8);
+		}
+		if(basicIn){
+			for(size_t page = 0xA0; page <= 0xBF; page++){
+				readPages[page] = rom_basic + ((page - 0xA0) << 8);
+			}
+		}
+		if(kernalIn){
+			for(size_t page = 0xE0; page <= 0xFF; page++){
+				readPages[page] = rom_kernal + ((page - 0xE0) << 8);
+			}
+		}
+	}
+	
 	virtual void Read(const MemoryByte&mb)
 	{
 	}
@@ -36,16 +77,41 @@ class C64Memory : public Memory
 	{
 	}
 	
-	C64Memory() : ram{}
+	void CopyCHRGET()
 	{
-		//Copy CHRGET
 		for(size_t src = 0xE3A2, dst = 0x73; src <= 0xE3BE; src++, dst++){
 			ram[dst] = (*this)[src];
 		}
+	}
+	
+	C64Memory() : ram{}
+	{
+		SetBanking(true, true);
+		
+		//Copy CHRGET
+		CopyCHRGET();
 		
 		//Patch out multiply bug
 		// https://www.c64-wiki.com/wiki/Multiply_bug
 		//std::printf("Memory --------------------- %02x\n", (*this)[0xA000 + 0x1a4f].inspect());
 		ram[0xA000 + 0x1A4F] = 0x5E;
 	}
+	
+	//The page tables point into ram, so a copy has to rebuild its own
+	C64Memory(const C64Memory &other) : Memory(other)
+	{
+		std::memcpy(ram, other.ram, sizeof(ram));
+		SetBanking(other.basicIn, other.kernalIn);
+	}
+	
+	C64Memory &operator=(const C64Memory &other)
+	{
+		std::memcpy(ram, other.ram, sizeof(ram));
+		SetBanking(other.basicIn, other.kernalIn);
+		return *this;
+	}
 };
+
+typedef MachineT<C64Memory> C64Machine;
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef _C64TRANSLATED_H
+#define _C64TRANSLATED_H
+
+#include "C64Memory.h"
+
+//ROM routines translated ahead of time by tools/romgen (rom_translated.cpp).
+//RunTranslatedROM runs from registers.pc for as long as execution stays in
+//translated code and returns the cycles used, leaving registers.pc at the
+//first address that has to be interpreted.
+bool IsTranslatedROM(uint16_t pc);
+unsigned int RunTranslatedROM(C64Machine &cpu);
+
+#endif
@@ -0,0 +1,15 @@
+#include "C64Translated.h"
+
+//Generated by tools/romgen from the ROM images. The images are omitted
+//for copyright reasons, so nothing is translated here; run "make romgen"
+//after inserting them to regenerate this file.
+
+bool IsTranslatedROM(uint16_t pc)
+{
+	return false;
+}
+
+unsigned int RunTranslatedROM(C64Machine &cpu)
+{
+	return 0;
+}
@@ -0,0 +1,66 @@
+//Checks C64Float::Compare and the comparison operators against
+//C64Math::FCOMP on random pairs, biased towards equal and nearly equal
+//values, zero exponents and equal exponents. Exits with 1 if any pair
+//disagrees.
+//
+//Usage: cmptest [pairs] [seed]   (default: 2000000 1)
+
+#include "../src/C64Float.h"
+#include "../src/C64Math.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+//xorshift32, so that a seed gives the same pairs everywhere
+static uint32_t state = 1;
+
+static uint32_t Random()
+{
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+int main(int argc, char **argv)
+{
+	long pairs = argc > 1 ? std::atol(argv[1]) : 2000000;
+	state = argc > 2 ? std::strtoul(argv[2], 0, 0) : 1;
+	if(!state) state = 1;
+	
+	long failed = 0;
+	for(long i = 0; i < pairs; i++){
+		C64Float a, b;
+		for(int j = 0; j < 5; j++){
+			a.val[j] = Random();
+			b.val[j] = Random();
+		}
+		switch(Random() % 6){
+			case 0: b = a; break;
+			case 1: b = a; b.val[Random() % 5] ^= 1 << (Random() % 8); break;
+			case 2: a.val[0] = 0; break;
+			case 3: b.val[0] = 0; if(Random() & 1) a.val[0] = 0; break;
+			case 4: b.val[0] = a.val[0]; break;
+			default: break;
+		}
+		
+		C64Math m;
+		m.MOVFM(a.val);
+		uint8_t sign = m.FCOMP(b.val);
+		int expected = sign == 0 ? 0 : sign == 1 ? 1 : -1;
+		int got = a.Compare(b);
+		
+		bool ok = got == expected;
+		ok = ok && (a > b) == (expected > 0) && (a < b) == (expected < 0);
+		ok = ok && (a >= b) == (expected >= 0) && (a <= b) == (expected <= 0);
+		ok = ok && (a == b) == (expected == 0) && (a != b) == (expected != 0);
+		if(!ok){
+			if(failed < 5) std::printf("%02X%02X%02X%02X%02X vs %02X%02X%02X%02X%02X: FCOMP %d, Compare %d\n", a.val[0], a.val[1], a.val[2], a.val[3], a.val[4], b.val[0], b.val[1], b.val[2], b.val[3], b.val[4], expected, got);
+			failed++;
+		}
+	}
+	
+	if(failed) std::printf("%ld of %ld pairs disagree\n", failed, pairs);
+	return failed != 0;
+}
@@ -0,0 +1,46 @@
+//Checks C64Float::Fuse against the same arithmetic done on C64Float values
+//one operator at a time, in native mode so that no ROM images are needed.
+//Exits with 1 if any check fails.
+
+#include "../src/C64Float.h"
+
+#include <cstdio>
+#include <cstring>
+
+static int failed = 0;
+
+static void Check(const char *what, const C64Float got, const C64Float expected)
+{
+	if(!std::memcmp(got.val, expected.val, sizeof(got.val))) return;
+	char a[32], b[32];
+	C64Float(got).toString(a);
+	C64Float(expected).toString(b);
+	std::printf("%s: got %s, expected %s\n", what, a, b);
+	failed++;
+}
+
+int main()
+{
+	C64Float::native = true;
+	
+	const C64Float l[] = {1.5, 1, 3, 0.25, -7};
+	const C64Float &a = l[0], &b = l[1], &c = l[2], &d = l[3], &e = l[4];
+	
+	Check("f", C64Float::Fuse("f", l), a);
+	Check("ff*", C64Float::Fuse("ff*", l), a * b);
+	Check("ff*f+", C64Float::Fuse("ff*f+", l), a * b + c);
+	Check("fff*-", C64Float::Fuse("fff*-", l), a - b * c);
+	Check("ff-ff/*", C64Float::Fuse("ff-ff/*", l), (a - b) * (c / d));
+	Check("fffff+-*/", C64Float::Fuse("fffff+-*/", l), a / (b * (c - (d + e))));
+	Check("ff/f/f/f/", C64Float::Fuse("ff/f/f/f/", l), a / b / c / d / e);
+	
+	//Malformed text
+	Check("empty", C64Float::Fuse("", l), C64Float::zero);
+	Check("ff", C64Float::Fuse("ff", l), C64Float::zero);
+	Check("f*", C64Float::Fuse("f*", l), C64Float::zero);
+	Check("ff^", C64Float::Fuse("ff^", l), C64Float::zero);
+	Check("ff*+", C64Float::Fuse("ff*+", l), C64Float::zero);
+	
+	if(failed) std::printf("%d checks failed\n", failed);
+	return failed != 0;
+}
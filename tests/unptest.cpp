@@ -0,0 +1,171 @@
+//Checks chains of C64FloatUnpacked arithmetic against the same chains on
+//C64Float, where every result is packed, rounding it, and loaded back.
+//Half the chains start from a value left with a rounding byte, as FAC
+//holds it before ROUND, and storing that has to give what MOVMF stores.
+//Each step of a chain is also stored on the way, without changing the
+//value carried on. Operands lean towards zero, the exponent edges and
+//mantissas that carry out when rounded. SIGFPE has to be raised as often
+//either way. Exits with 1 if any chain disagrees.
+//
+//Usage: unptest [chains] [seed]   (default: 300000 1)
+
+#include "../src/C64Float.h"
+#include "../src/C64Math.h"
+
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+static volatile std::sig_atomic_t raised = 0;
+
+static void OnSIGFPE(int)
+{
+	raised = raised + 1;
+	std::signal(SIGFPE, OnSIGFPE);
+}
+
+//xorshift32, so that a seed gives the same chains everywhere
+static uint32_t state = 1;
+
+static uint32_t Random()
+{
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+static C64Float RandomFloat()
+{
+	C64Float f;
+	for(int i = 0; i < 5; i++) f.val[i] = Random();
+	switch(Random() % 8){
+		case 0: f.val[0] = 0; break;
+		case 1: f.val[0] = 0xF0 + Random() % 16; break;
+		case 2: f.val[0] = 1 + Random() % 16; break;
+		case 3: f.val[1] |= 0x7F; f.val[2] = f.val[3] = f.val[4] = 0xFF; break;
+		default: f.val[0] = 0x60 + Random() % 64; break;
+	}
+	return f;
+}
+
+static void Print(const char *label, const C64Float f)
+{
+	std::printf(" %s %02X%02X%02X%02X%02X", label, f.val[0], f.val[1], f.val[2], f.val[3], f.val[4]);
+}
+
+enum
+{
+	STEPS = 6
+};
+
+int main(int argc, char **argv)
+{
+	long chains = argc > 1 ? std::atol(argv[1]) : 300000;
+	state = argc > 2 ? std::strtoul(argv[2], 0, 0) : 1;
+	if(!state) state = 1;
+	
+	std::signal(SIGFPE, OnSIGFPE);
+	C64Float::native = true;
+	
+	long failed = 0;
+	for(long i = 0; i < chains; i++){
+		C64Float first = RandomFloat(), operands[STEPS];
+		int ops[STEPS];
+		for(int j = 0; j < STEPS; j++){
+			operands[j] = RandomFloat();
+			ops[j] = Random() % 9;
+		}
+		C64FloatUnpacked u(first);
+		if(Random() & 1){
+			if(Random() % 8 == 0) first = C64Float(0xFF, 0x7F, 0xFF, 0xFF, 0xFF);
+			u = C64FloatUnpacked(first);
+			u.rounding = Random();
+		}
+		bool ok = true;
+		
+		//The start as MOVMF stores it, ROUND overflowing or not
+		C64Float p = first;
+		C64Math m;
+		m.MOVFM(first.val);
+		m.zp[C64Math::FACEXTENSION] = u.rounding;
+		raised = 0;
+		try{
+			m.MOVMF(p.val);
+		}
+		catch(const C64Math::Error &){
+			std::raise(SIGFPE);
+		}
+		int startRaised = raised;
+		raised = 0;
+		const C64Float start = u;
+		if(std::memcmp(start.val, p.val, sizeof(p.val)) || raised != startRaised){
+			if(failed < 5){
+				std::printf("chain %ld start, rounding %02X:", i, u.rounding);
+				Print("MOVMF", p);
+				Print("unpacked", start);
+				std::printf("\n");
+			}
+			ok = false;
+		}
+		
+		//Packed after every operator
+		C64Float packed[STEPS];
+		raised = startRaised;
+		for(int j = 0; j < STEPS; j++){
+			const C64Float o = operands[j];
+			switch(ops[j]){
+				case 0: p = p + o; break;
+				case 1: p = p - o; break;
+				case 2: p = p * o; break;
+				case 3: p = p / o; break;
+				case 4: p = o + p; break;
+				case 5: p = o - p; break;
+				case 6: p = o * p; break;
+				case 7: p = o / p; break;
+				default: p = -p; break;
+			}
+			packed[j] = p;
+		}
+		int packedRaised = raised;
+		
+		//Unpacked throughout, stored only to compare. The first operator
+		//rounds the start, as storing it did.
+		raised = 0;
+		for(int j = 0; ok && j < STEPS; j++){
+			const C64Float o = operands[j];
+			switch(ops[j]){
+				case 0: u += o; break;
+				case 1: u = u - o; break;
+				case 2: u *= C64FloatUnpacked(o); break;
+				case 3: u = u / o; break;
+				case 4: u = C64FloatUnpacked(o) + u; break;
+				case 5: u = o - u; break;
+				case 6: u = o * u; break;
+				case 7: u = o / u; break;
+				default: u = -u; break;
+			}
+			const C64Float stored = u;
+			if(std::memcmp(stored.val, packed[j].val, sizeof(stored.val))){
+				if(failed < 5){
+					std::printf("chain %ld step %d:", i, j);
+					Print("packed", packed[j]);
+					Print("unpacked", stored);
+					std::printf("\n");
+				}
+				ok = false;
+				break;
+			}
+		}
+		if(ok && raised != packedRaised){
+			if(failed < 5) std::printf("chain %ld: SIGFPE %d times packed, %d unpacked\n", i, packedRaised, (int) raised);
+			ok = false;
+		}
+		failed += !ok;
+	}
+	C64Float::native = false;
+	
+	if(failed) std::printf("%ld of %ld chains disagree\n", failed, chains);
+	return failed != 0;
+}
@@ -0,0 +1,231 @@
+//Compares the native C64Math routines with the ROM ones they were ported
+//from. Every routine is run on the same random operands with
+//C64Float::native off, on the emulated machine, and on, and the two must
+//give the same bytes and raise SIGFPE alike. Operands are weighted
+//towards each routine's useful range and include zero, errors and the
+//exponent edges. Needs the real ROM images in place: with the zeroed
+//ones in the repository there is nothing to compare against, and it
+//exits with status 1.
+//
+//Usage: mathcheck [samples per routine] [seed]   (default: 50000 1)
+
+#include "../src/C64Float.h"
+#include "../src/C64Memory.h"
+
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+static volatile std::sig_atomic_t raised = 0;
+
+static void OnSIGFPE(int)
+{
+	raised = 1;
+	std::signal(SIGFPE, OnSIGFPE);
+}
+
+//xorshift32, so that a seed gives the same operands everywhere
+static uint32_t state = 1;
+
+static uint32_t Random()
+{
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+static C64Float RandomFloat()
+{
+	C64Float f;
+	for(int i = 0; i < 5; i++) f.val[i] = Random();
+	return f;
+}
+
+static void Print(const char *label, const C64Float f, int error)
+{
+	std::printf(" %s %02X%02X%02X%02X%02X%s", label, f.val[0], f.val[1], f.val[2], f.val[3], f.val[4], error ? "(error)" : "");
+}
+
+enum Routine
+{
+	FADD, FSUB, FMUL, FDIV,
+	SQR, ATN, COS, EXP, SIN, TAN, LOG, PWR,
+	FIN, FOUT,
+	ROUTINE_COUNT
+};
+
+static const char *names[ROUTINE_COUNT] = {
+	"FADD", "FSUB", "FMUL", "FDIV",
+	"SQR", "ATN", "COS", "EXP", "SIN", "TAN", "LOG", "PWR",
+	"FIN", "FOUT"
+};
+
+//Operands for the arithmetic: close exponents, small ones, equal and
+//nearly equal values, zeros and mantissas about to carry out
+static void Arithmetic(C64Float &a, C64Float &b)
+{
+	a = RandomFloat();
+	b = RandomFloat();
+	switch(Random() % 8){
+		case 0: b.val[0] = a.val[0] + Random() % 5 - 2; break;
+		case 1: a.val[0] = 0x6C + Random() % 40; b.val[0] = 0x6C + Random() % 40; break;
+		case 2: b = a; b.val[4] ^= Random() & 3; b.val[1] ^= Random() & 0x80; break;
+		case 3: b.val[0] = 0; break;
+		case 4: a.val[0] = 0; break;
+		case 5: a.val[1] |= 0x7F; a.val[2] = a.val[3] = a.val[4] = 0xFF; break;
+		default: break;
+	}
+}
+
+//Operands for the functions, mostly where they are useful
+static void Function(Routine routine, C64Float &a, C64Float &b)
+{
+	a = RandomFloat();
+	b = RandomFloat();
+	switch(Random() % 6){
+		case 0: case 1: case 2: a.val[0] = 0x70 + Random() % 0x20; break;
+		case 3: a.val[0] = 0x81 + Random() % 8; break;
+		case 4: if(Random() & 1) a.val[0] = 0; break;
+		default: break;
+	}
+	if(routine == PWR){
+		b.val[0] = 0x78 + Random() % 0x10;
+		if(Random() % 4 == 0) b = C64Float((int) (Random() % 11) - 5);
+		if(Random() % 8 == 0) b.val[0] = 0;
+	}
+}
+
+//Text for FIN: printed numbers, edge cases and random junk
+static void Text(char *s)
+{
+	static const char *cases[] = {
+		"1E40", "1E39", "1.7E38", "1E-39", "1E-40", "-1E-50", "1E100", "1E-100", "1E+5", "  12 34",
+		"1..5", ".5", "-.5E-3", "+7", "E5", "-", "1E", "99999999999999", "123456789.5", "0.000000001",
+		"1E-2E3", "3.14159265358979", ""
+	};
+	switch(Random() % 5){
+		case 0:
+			RandomFloat().toString(s);
+			break;
+		case 1:
+			std::sprintf(s, "%d", (int) (Random() % 100000) - 50000);
+			break;
+		case 2:
+			std::sprintf(s, "%.*E", (int) (Random() % 12), (Random() % 100000 + 1.0) * ((Random() & 1) ? 1e-3 : 1e3));
+			break;
+		case 3:
+			std::strcpy(s, cases[Random() % (sizeof(cases) / sizeof(cases[0]))]);
+			break;
+		default:
+			{
+				const char *chars = "0123456789.E-+ ";
+				int length = Random() % 14;
+				for(int i = 0; i < length; i++) s[i] = chars[Random() % 15];
+				s[length] = 0;
+			}
+			break;
+	}
+}
+
+static C64Float Run(Routine routine, C64Float a, C64Float b, const char *text)
+{
+	C64Float f;
+	switch(routine){
+		case FADD: return a + b;
+		case FSUB: return a - b;
+		case FMUL: return a * b;
+		case FDIV: return a / b;
+		case SQR: return a.sqrt();
+		case ATN: return a.atan();
+		case COS: return a.cos();
+		case EXP: return a.exp();
+		case SIN: return a.sin();
+		case TAN: return a.tan();
+		case LOG: return a.log();
+		case PWR: return a.pow(b);
+		default:
+			std::memset(f.val, 0x55, sizeof(f.val));
+			f.fromString(text);
+			return f;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	long samples = argc > 1 ? std::atol(argv[1]) : 50000;
+	state = argc > 2 ? std::strtoul(argv[2], 0, 0) : 1;
+	if(!state) state = 1;
+
+	bool present = false;
+	for(size_t i = 0; i < sizeof(C64Memory::rom_basic); i++) present |= C64Memory::rom_basic[i] != 0;
+	if(!present){
+		std::fprintf(stderr, "The BASIC ROM image is missing, there is nothing to compare against\n");
+		return 1;
+	}
+
+	std::signal(SIGFPE, OnSIGFPE);
+
+	long total = 0;
+	std::printf("routine   samples  mismatches  ROM errors\n");
+	for(int r = 0; r < ROUTINE_COUNT; r++){
+		Routine routine = (Routine) r;
+		long mismatches = 0, errors = 0;
+		for(long i = 0; i < samples; i++){
+			C64Float a, b;
+			char text[64] = "";
+			if(routine <= FDIV) Arithmetic(a, b);
+			else if(routine <= PWR) Function(routine, a, b);
+			else if(routine == FIN) Text(text);
+			else{
+				a = RandomFloat();
+				if(Random() % 10 == 0) a.val[0] = 0;
+			}
+
+			if(routine == FOUT){
+				char rom[64], native[64];
+				C64Float::native = false;
+				a.toString(rom);
+				C64Float::native = true;
+				a.toString(native);
+				if(std::strcmp(rom, native)){
+					if(mismatches < 5) std::printf("FOUT %02X%02X%02X%02X%02X ROM '%s' native '%s'\n", a.val[0], a.val[1], a.val[2], a.val[3], a.val[4], rom, native);
+					mismatches++;
+				}
+				continue;
+			}
+
+			C64Float rom, native;
+			int romError, nativeError;
+			raised = 0;
+			C64Float::native = false;
+			rom = Run(routine, a, b, text);
+			romError = raised;
+			raised = 0;
+			C64Float::native = true;
+			native = Run(routine, a, b, text);
+			nativeError = raised;
+
+			errors += romError;
+			if(romError != nativeError || std::memcmp(rom.val, native.val, sizeof(rom.val))){
+				if(mismatches < 5){
+					std::printf("%s", names[routine]);
+					if(routine == FIN) std::printf(" '%s'", text);
+					else Print("a", a, 0);
+					if(routine <= FDIV || routine == PWR) Print("b", b, 0);
+					Print("ROM", rom, romError);
+					Print("native", native, nativeError);
+					std::printf("\n");
+				}
+				mismatches++;
+			}
+		}
+		std::printf("%-8s %8ld  %10ld  %10ld\n", names[routine], samples, mismatches, errors);
+		total += mismatches;
+	}
+	C64Float::native = false;
+
+	std::printf("%ld mismatches\n", total);
+	return total != 0;
+}
@@ -0,0 +1,459 @@
+// Ahead-of-time translator for the BASIC/KERNAL ROM code used by C64Float.
+//
+// Follows the control flow of the ROM images from the entry points that
+// C64Float.cpp calls and writes C++ that performs the same register, flag,
+// memory and cycle effects as MachineT::DoStep, one labelled block per
+// instruction. Anything it cannot follow statically (indirect jumps, RTS,
+// RTI) goes through a dispatch switch, and anything it does not translate
+// (RAM, undocumented opcodes, BRK, stop addresses) returns to the
+// interpreter with registers.pc set.
+//
+// Usage: romgen [output.cpp]   (default: src/rom_translated.cpp)
+
+#include "../src/C64Memory.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <set>
+#include <vector>
+
+//Routines called by the stubs in C64Float.cpp
+static const uint16_t entries[] = {
+	0xBBA2, //MOVFM
+	0xBA8C, //CONUPK
+	0xBBD4, //MOVMF
+	0xBBFC, //MOVEF
+	0xBC0F, //MOVFA
+	0xB867, //FADD
+	0xB850, //FSUB
+	0xBB0F, //FDIV
+	0xBA28, //FMUL
+	0xBF71, //SQR
+	0xBC58, //ABS
+	0xBCF3, //FIN
+	0xBDDD, //FOUT
+	0xBC5B, //FCOMP
+	0xE30E, //ATN
+	0xE264, //COS
+	0xBFED, //EXP
+	0xBF78, //PWR
+	0xBF7B, //PWR_
+	0xB9EA, //LOG
+	0xE26B, //SIN
+	0xE2B4, //TAN
+	0xBCCC, //INT
+	0xBC9B, //QINT
+};
+
+//C64Prog::execute stops when reaching these, so they are never translated
+static const uint16_t stops[] = {
+	0xFF48,
+};
+
+static bool IsROM(unsigned int address)
+{
+	return (address >= 0xA000 && address <= 0xBFFF) || (address >= 0xE000 && address <= 0xFFFF);
+}
+
+static uint8_t ReadROM(uint16_t address)
+{
+	if(address >= 0xE000) return C64Memory::rom_kernal[address - 0xE000];
+	return C64Memory::rom_basic[address - 0xA000];
+}
+
+static bool IsDocumented(Instruction::Type instruction)
+{
+	return instruction <= Instruction::TYA && instruction != Instruction::BRK;
+}
+
+static bool IsBranch(Instruction::Type instruction)
+{
+	switch(instruction){
+		case Instruction::BCC: case Instruction::BCS: case Instruction::BEQ: case Instruction::BMI:
+		case Instruction::BNE: case Instruction::BPL: case Instruction::BVC: case Instruction::BVS:
+			return true;
+		default:
+			return false;
+	}
+}
+
+//An instruction can be translated if it is documented and lies wholly in ROM
+static bool Translatable(uint16_t address)
+{
+	if(!IsROM(address)) return false;
+	for(size_t i = 0; i < sizeof(stops) / sizeof(stops[0]); i++){
+		if(stops[i] == address) return false;
+	}
+	const OpCode &op = opCodes[ReadROM(address)];
+	if(!IsDocumented(op.instruction)) return false;
+	return IsROM(address + Length(op.addressing) - 1);
+}
+
+static std::set<uint16_t> translated;
+
+static void Follow()
+{
+	std::vector<uint16_t> work(entries, entries + sizeof(entries) / sizeof(entries[0]));
+	while(!work.empty()){
+		uint16_t address = work.back();
+		work.pop_back();
+		if(translated.count(address) || !Translatable(address)) continue;
+		translated.insert(address);
+
+		const OpCode &op = opCodes[ReadROM(address)];
+		uint16_t next = address + Length(op.addressing);
+		uint16_t target = ReadROM(address + 1) | (op.addressing == Addressing::Absolute ? ReadROM(address + 2) << 8 : 0);
+		switch(op.instruction){
+			case Instruction::JMP:
+				if(op.addressing == Addressing::Absolute) work.push_back(target);
+				break;
+			case Instruction::JSR:
+				work.push_back(target);
+				work.push_back(next);
+				break;
+			case Instruction::RTS:
+			case Instruction::RTI:
+				break;
+			default:
+				if(IsBranch(op.instruction)){
+					uint8_t offset = ReadROM(address + 1);
+					work.push_back((offset & 0x80u) ? next - (0x100u - offset) : next + offset);
+				}
+				work.push_back(next);
+				break;
+		}
+	}
+}
+
+static std::string Hex(unsigned int v)
+{
+	char s[16];
+	std::sprintf(s, "0x%04X", v);
+	return s;
+}
+
+static std::string Goto(uint16_t address)
+{
+	if(translated.count(address)) return "goto L_" + Hex(address).substr(2) + ";";
+	return "{ registers.pc = " + Hex(address) + "; return cycles; }";
+}
+
+static const char *SetNZ(const char *reg)
+{
+	static char s[256];
+	std::sprintf(s,
+		"registers.p &= ~(Flags::Sign | Flags::Zero); "
+		"if((%s & 0x80u) != 0) registers.p |= Flags::Sign; "
+		"if(%s == 0) registers.p |= Flags::Zero;", reg, reg);
+	return s;
+}
+
+static void Emit(FILE *f, uint16_t pc)
+{
+	uint8_t opCode = ReadROM(pc);
+	const OpCode &op = opCodes[opCode];
+	uint8_t operandA = ReadROM(pc + 1), operandB = 0;
+	unsigned int length = Length(op.addressing);
+	if(length == 3) operandB = ReadROM(pc + 2);
+	uint16_t operand = operandA | (operandB << 8);
+	uint16_t next = pc + length;
+	bool reads = true;
+
+	std::fprintf(f, "L_%04X: //%s\n", pc, Instruction::toString[op.instruction]);
+	std::fprintf(f, "\tcycles += %u;\n", op.cycles);
+
+	//Effective address, with the page boundary test written as in DoStep
+	switch(op.addressing){
+		case Addressing::Accumulator:
+			std::fprintf(f, "\tvalue = registers.a;\n");
+			reads = false;
+			break;
+		case Addressing::Immediate:
+			std::fprintf(f, "\tvalue = 0x%02X;\n", operandA);
+			reads = false;
+			break;
+		case Addressing::Implicit:
+		case Addressing::Relative:
+		case Addressing::Unknown:
+			reads = false;
+			break;
+		case Addressing::Absolute:
+			std::fprintf(f, "\taddress = %s;\n", Hex(operand).c_str());
+			break;
+		case Addressing::ZeroPage:
+			std::fprintf(f, "\taddress = 0x%02X;\n", operandA);
+			break;
+		case Addressing::Indirect:
+			std::fprintf(f, "\taddress = memory.ReadByte(%s) | (memory.ReadByte(%s) << 8u);\n",
+				Hex(operand).c_str(), Hex((operand & 0xFF00u) | ((operand + 1u) & 0xFFu)).c_str());
+			reads = false;
+			break;
+		case Addressing::AbsoluteX:
+		case Addressing::AbsoluteY:
+		{
+			const char *index = op.addressing == Addressing::AbsoluteX ? "registers.x" : "registers.y";
+			if(op.pageBoundaryPenalty){
+				std::fprintf(f, "\tif(uint8_t(0x%02X) <= %s) cycles++;\n", uint8_t(~operandA), index);
+			}
+			std::fprintf(f, "\taddress = %s + %s;\n", Hex(operand).c_str(), index);
+			break;
+		}
+		case Addressing::ZeroPageX:
+			std::fprintf(f, "\taddress = (0x%02X + registers.x) & 0xFFu;\n", operandA);
+			break;
+		case Addressing::ZeroPageY:
+			std::fprintf(f, "\taddress = (0x%02X + registers.y) & 0xFFu;\n", operandA);
+			break;
+		case Addressing::IndirectX:
+			std::fprintf(f, "\taddress = memory.ReadByte((0x%02X + registers.x) & 0xFFu) | (memory.ReadByte((0x%02X + registers.x + 1u) & 0xFFu) << 8u);\n",
+				operandA, operandA);
+			break;
+		case Addressing::IndirectY:
+			std::fprintf(f, "\taddress = memory.ReadByte(0x%02X) | (memory.ReadByte(0x%02X) << 8u);\n",
+				operandA, (operandA + 1u) & 0xFFu);
+			if(op.pageBoundaryPenalty){
+				std::fprintf(f, "\tif(temp8 = ~(address & 0xFFu), temp8 <= registers.y) cycles++;\n");
+			}
+			std::fprintf(f, "\taddress += registers.y;\n");
+			break;
+	}
+
+	const char *load = reads ? "\tvalue = memory.ReadByte(address);\n" : "";
+	const char *put = op.addressing == Addressing::Accumulator ?
+		"\tregisters.a = temp & 0xFFu;\n" : "\tmemory.WriteByte(address, temp & 0xFFu);\n";
+
+	if(IsBranch(op.instruction)){
+		static const char *conditions[] = {
+			"(registers.p & Flags::Carry) == 0",    //BCC
+			"(registers.p & Flags::Carry) != 0",    //BCS
+			"(registers.p & Flags::Zero) != 0",     //BEQ
+			"",
+			"(registers.p & Flags::Sign) != 0",     //BMI
+			"(registers.p & Flags::Zero) == 0",     //BNE
+			"(registers.p & Flags::Sign) == 0",     //BPL
+			"",
+			"(registers.p & Flags::Overflow) == 0", //BVC
+			"(registers.p & Flags::Overflow) != 0", //BVS
+		};
+		uint16_t target = (operandA & 0x80u) ? next - (0x100u - operandA) : next + operandA;
+		unsigned int taken = 1 + ((target & 0xFF00u) != (next & 0xFF00u));
+		std::fprintf(f, "\tif(%s){ cycles += %u; %s }\n", conditions[op.instruction - Instruction::BCC], taken, Goto(target).c_str());
+		std::fprintf(f, "\t%s\n", Goto(next).c_str());
+		return;
+	}
+
+	switch(op.instruction){
+		case Instruction::ADC:
+			std::fprintf(f, "%s", load);
+			std::fprintf(f,
+				"\ttemp = registers.a + value + (registers.p & 1u);\n"
+				"\tregisters.p &= ~(Flags::Carry | Flags::Zero | Flags::Overflow | Flags::Sign);\n"
+				"\tif(temp > 0xFFu) registers.p |= Flags::Carry;\n"
+				"\tif(((~(registers.a ^ value)) & (registers.a ^ temp) & 0x80u) != 0) registers.p |= Flags::Overflow;\n"
+				"\tif((temp & 0xFFu) == 0) registers.p |= Flags::Zero;\n"
+				"\tif(temp & 128u) registers.p |= Flags::Sign;\n"
+				"\tregisters.a = temp & 0xFFu;\n");
+			break;
+		case Instruction::SBC:
+			std::fprintf(f, "%s", load);
+			std::fprintf(f,
+				"\ttemp = registers.a;\n"
+				"\ttemp -= value + (!(registers.p & Flags::Carry));\n"
+				"\tregisters.p &= ~(Flags::Carry | Flags::Zero | Flags::Overflow | Flags::Sign);\n"
+				"\tif(!(temp > 0xFFu)) registers.p |= Flags::Carry;\n"
+				"\tif((registers.a ^ temp) & (registers.a ^ value) & 0x80u) registers.p |= Flags::Overflow;\n"
+				"\tif((temp & 0xFFu) == 0) registers.p |= Flags::Zero;\n"
+				"\tif(temp & 128u) registers.p |= Flags::Sign;\n"
+				"\tregisters.a = temp & 0xFFu;\n");
+			break;
+		case Instruction::AND:
+			std::fprintf(f, "%s\tregisters.a &= value;\n\t%s\n", load, SetNZ("registers.a"));
+			break;
+		case Instruction::ORA:
+			std::fprintf(f, "%s\tregisters.a |= value;\n\t%s\n", load, SetNZ("registers.a"));
+			break;
+		case Instruction::EOR:
+			std::fprintf(f, "%s\tregisters.a ^= value;\n\t%s\n", load, SetNZ("registers.a"));
+			break;
+		case Instruction::BIT:
+			std::fprintf(f, "%s", load);
+			std::fprintf(f,
+				"\ttemp = registers.a & value;\n"
+				"\tregisters.p &= ~(Flags::Zero | Flags::Sign | Flags::Overflow);\n"
+				"\tif((temp & 0xFFu) == 0) registers.p |= Flags::Zero;\n"
+				"\tif(value & Flags::Sign) registers.p |= Flags::Sign;\n"
+				"\tif(value & Flags::Overflow) registers.p |= Flags::Overflow;\n");
+			break;
+		case Instruction::ASL:
+			std::fprintf(f, "%s", load);
+			std::fprintf(f,
+				"\ttemp = value << 1u;\n"
+				"\tregisters.p &= ~(Flags::Sign | Flags::Zero | Flags::Carry);\n"
+				"\tif((temp & 0x100u) != 0u) registers.p |= Flags::Carry;\n"
+				"\tif((temp & 0xFFu) == 0u) registers.p |= Flags::Zero;\n"
+				"\tif(temp & 128u) registers.p |= Flags::Sign;\n%s", put);
+			break;
+		case Instruction::LSR:
+			std::fprintf(f, "%s", load);
+			std::fprintf(f,
+				"\ttemp = value >> 1u;\n"
+				"\tregisters.p &= ~(Flags::Sign | Flags::Zero | Flags::Carry);\n"
+				"\tif((value & 1u) != 0) registers.p |= Flags::Carry;\n"
+				"\tif((temp & 0xFFu) == 0) registers.p |= Flags::Zero;\n"
+				"\tif(temp & 128u) registers.p |= Flags::Sign;\n%s", put);
+			break;
+		case Instruction::ROL:
+			std::fprintf(f, "%s", load);
+			std::fprintf(f,
+				"\ttemp = (value << 1u) | (registers.p & Flags::Carry);\n"
+				"\tregisters.p &= ~(Flags::Sign | Flags::Zero | Flags::Carry);\n"
+				"\tif(value & 128u) registers.p |= Flags::Carry;\n"
+				"\tif((temp & 0xFFu) == 0) registers.p |= Flags::Zero;\n"
+				"\tif((temp & 0x80u) != 0) registers.p |= Flags::Sign;\n%s", put);
+			break;
+		case Instruction::ROR:
+			std::fprintf(f, "%s", load);
+			std::fprintf(f,
+				"\ttemp = (value >> 1u) | ((registers.p & Flags::Carry) << 7u);\n"
+				"\tregisters.p &= ~(Flags::Sign | Flags::Zero | Flags::Carry);\n"
+				"\tif((value & 1u) != 0) registers.p |= Flags::Carry;\n"
+				"\tif((temp & 0xFFu) == 0) registers.p |= Flags::Zero;\n"
+				"\tif((temp & 0x80u) != 0) registers.p |= Flags::Sign;\n%s", put);
+			break;
+		case Instruction::CMP:
+		case Instruction::CPX:
+		case Instruction::CPY:
+			std::fprintf(f, "%s", load);
+			std::fprintf(f, "\ttemp = registers.%c;\n",
+				op.instruction == Instruction::CMP ? 'a' : op.instruction == Instruction::CPX ? 'x' : 'y');
+			std::fprintf(f,
+				"\tregisters.p &= ~(Flags::Sign | Flags::Zero | Flags::Carry);\n"
+				"\tif(temp >= value) registers.p |= Flags::Carry;\n"
+				"\tif(temp == value) registers.p |= Flags::Zero;\n"
+				"\ttemp8 = temp & 0xFFu;\n"
+				"\ttemp8 -= value;\n"
+				"\tif((temp8 & Flags::Sign) != 0) registers.p |= Flags::Sign;\n");
+			break;
+		case Instruction::DEC:
+		case Instruction::INC:
+			std::fprintf(f, "%s\tvalue %s= 1u;\n\t%s\n\tmemory.WriteByte(address, value);\n",
+				load, op.instruction == Instruction::INC ? "+" : "-", SetNZ("value"));
+			break;
+		case Instruction::LDA: std::fprintf(f, "%s\tregisters.a = value;\n\t%s\n", load, SetNZ("registers.a")); break;
+		case Instruction::LDX: std::fprintf(f, "%s\tregisters.x = value;\n\t%s\n", load, SetNZ("registers.x")); break;
+		case Instruction::LDY: std::fprintf(f, "%s\tregisters.y = value;\n\t%s\n", load, SetNZ("registers.y")); break;
+		case Instruction::STA: std::fprintf(f, "\tmemory.WriteByte(address, registers.a);\n"); break;
+		case Instruction::STX: std::fprintf(f, "\tmemory.WriteByte(address, registers.x);\n"); break;
+		case Instruction::STY: std::fprintf(f, "\tmemory.WriteByte(address, registers.y);\n"); break;
+		case Instruction::TAX: std::fprintf(f, "\tregisters.x = registers.a;\n\t%s\n", SetNZ("registers.a")); break;
+		case Instruction::TAY: std::fprintf(f, "\tregisters.y = registers.a;\n\t%s\n", SetNZ("registers.a")); break;
+		case Instruction::TXA: std::fprintf(f, "\tregisters.a = registers.x;\n\t%s\n", SetNZ("registers.a")); break;
+		case Instruction::TYA: std::fprintf(f, "\tregisters.a = registers.y;\n\t%s\n", SetNZ("registers.a")); break;
+		case Instruction::TSX: std::fprintf(f, "\tregisters.x = registers.s;\n\t%s\n", SetNZ("registers.x")); break;
+		case Instruction::TXS: std::fprintf(f, "\tregisters.s = registers.x;\n"); break;
+		case Instruction::INX: std::fprintf(f, "\tregisters.x++;\n\t%s\n", SetNZ("registers.x")); break;
+		case Instruction::DEX: std::fprintf(f, "\tregisters.x--;\n\t%s\n", SetNZ("registers.x")); break;
+		case Instruction::INY: std::fprintf(f, "\tregisters.y++;\n\t%s\n", SetNZ("registers.y")); break;
+		case Instruction::DEY: std::fprintf(f, "\tregisters.y--;\n\t%s\n", SetNZ("registers.y")); break;
+		case Instruction::CLC: std::fprintf(f, "\tregisters.p &= ~Flags::Carry;\n"); break;
+		case Instruction::SEC: std::fprintf(f, "\tregisters.p |= Flags::Carry;\n"); break;
+		case Instruction::CLI: std::fprintf(f, "\tregisters.p &= ~Flags::Interrupt;\n"); break;
+		case Instruction::SEI: std::fprintf(f, "\tregisters.p |= Flags::Interrupt;\n"); break;
+		case Instruction::CLV: std::fprintf(f, "\tregisters.p &= ~Flags::Overflow;\n"); break;
+		case Instruction::CLD: std::fprintf(f, "\tregisters.p &= ~Flags::Decimal;\n"); break;
+		case Instruction::SED: std::fprintf(f, "\tregisters.p |= Flags::Decimal;\n"); break;
+		case Instruction::NOP: std::fprintf(f, "%s", load); break;
+		case Instruction::PHA: std::fprintf(f, "\tmemory.WriteByte(0x0100u | (registers.s--), registers.a);\n"); break;
+		case Instruction::PHP: std::fprintf(f, "\tmemory.WriteByte(0x0100u | (registers.s--), registers.p | 0x30u);\n"); break;
+		case Instruction::PLA:
+			std::fprintf(f, "\tregisters.a = memory.ReadByte(0x0100u | ((++registers.s) & 0xFFu));\n\t%s\n", SetNZ("registers.a"));
+			break;
+		case Instruction::PLP:
+			std::fprintf(f, "\tregisters.p = memory.ReadByte(0x0100u | ((++registers.s) & 0xFFu));\n");
+			break;
+		case Instruction::JMP:
+			if(op.addressing == Addressing::Absolute){
+				std::fprintf(f, "\t%s\n", Goto(operand).c_str());
+			}
+			else{
+				std::fprintf(f, "\tregisters.pc = address;\n\tgoto dispatch;\n");
+			}
+			return;
+		case Instruction::JSR:
+			std::fprintf(f, "\tmemory.WriteByte(0x0100u | (registers.s--), 0x%02X);\n", ((pc + 2u) >> 8u) & 0xFFu);
+			std::fprintf(f, "\tmemory.WriteByte(0x0100u | (registers.s--), 0x%02X);\n", (pc + 2u) & 0xFFu);
+			std::fprintf(f, "\t%s\n", Goto(operand).c_str());
+			return;
+		case Instruction::RTI:
+			std::fprintf(f, "\tregisters.p = memory.ReadByte(0x0100u | ((++registers.s) & 0xFFu));\n");
+			std::fprintf(f, "\tregisters.pc = memory.ReadByte(0x0100u | ((++registers.s) & 0xFFu));\n");
+			std::fprintf(f, "\tregisters.pc |= memory.ReadByte(0x0100u | ((++registers.s) & 0xFFu)) << 8u;\n");
+			std::fprintf(f, "\tgoto dispatch;\n");
+			return;
+		case Instruction::RTS:
+			std::fprintf(f, "\tregisters.pc = memory.ReadByte(0x0100u | ((++registers.s) & 0xFFu));\n");
+			std::fprintf(f, "\tregisters.pc |= memory.ReadByte(0x0100u | ((++registers.s) & 0xFFu)) << 8u;\n");
+			std::fprintf(f, "\tregisters.pc++;\n");
+			std::fprintf(f, "\tgoto dispatch;\n");
+			return;
+		default:
+			break;
+	}
+	std::fprintf(f, "\t%s\n", Goto(next).c_str());
+}
+
+int main(int argc, char **argv)
+{
+	const char *fn = argc > 1 ? argv[1] : "src/rom_translated.cpp";
+
+	Follow();
+
+	//The images in the repository are zeroed out, which would replace the
+	//file with one that translates nothing
+	if(translated.empty()){
+		std::fprintf(stderr, "%s: no ROM code to translate, the ROM images are missing; left unchanged\n", fn);
+		return 1;
+	}
+
+	FILE *f = std::fopen(fn, "w");
+	if(!f){
+		std::perror(fn);
+		return 1;
+	}
+
+	std::fprintf(f, "#include \"C64Translated.h\"\n\n");
+	std::fprintf(f, "//Generated by tools/romgen from the ROM images, do not edit\n\n");
+
+	std::fprintf(f, "static const uint8_t translatedMap[0x2000] = {\n");
+	uint8_t map[0x2000] = {};
+	for(std::set<uint16_t>::iterator it = translated.begin(); it != translated.end(); ++it){
+		map[*it >> 3] |= 1u << (*it & 7u);
+	}
+	for(size_t i = 0; i < sizeof(map); i++){
+		std::fprintf(f, "%s0x%02X,%s", (i % 16) ? " " : "\t", map[i], (i % 16 == 15) ? "\n" : "");
+	}
+	std::fprintf(f, "};\n\n");
+
+	std::fprintf(f, "bool IsTranslatedROM(uint16_t pc)\n{\n\treturn translatedMap[pc >> 3] & (1u << (pc & 7u));\n}\n\n");
+
+	std::fprintf(f, "unsigned int RunTranslatedROM(C64Machine &cpu)\n{\n");
+	std::fprintf(f, "\tC64Machine::Registers &registers = cpu.registers;\n");
+	std::fprintf(f, "\tC64Memory &memory = cpu.memory;\n");
+	std::fprintf(f, "\tunsigned int cycles = 0;\n");
+	std::fprintf(f, "\tuint16_t address = 0, temp = 0;\n");
+	std::fprintf(f, "\tuint8_t value = 0, temp8 = 0;\n\n");
+	std::fprintf(f, "dispatch:\n\tswitch(registers.pc){\n");
+	for(std::set<uint16_t>::iterator it = translated.begin(); it != translated.end(); ++it){
+		std::fprintf(f, "\t\tcase 0x%04X: goto L_%04X;\n", *it, *it);
+	}
+	std::fprintf(f, "\t\tdefault: return cycles;\n\t}\n\n");
+	for(std::set<uint16_t>::iterator it = translated.begin(); it != translated.end(); ++it){
+		Emit(f, *it);
+	}
+	std::fprintf(f, "}\n");
+
+	std::fclose(f);
+	std::printf("%s: %u instructions translated\n", fn, (unsigned int) translated.size());
+	return 0;
+}
@@ -0,0 +1,30 @@
+//Turns the binary trace written by a TRACE build into VICE-style text,
+//one line per instruction, the format the core used to write directly.
+//
+//Usage: tracefmt [trace.bin]   (default: standard input)
+
+#include "../src/6502.h"
+
+#include <cstdio>
+
+int main(int argc, char **argv)
+{
+	FILE *f = argc > 1 ? std::fopen(argv[1], "rb") : stdin;
+	if(!f){
+		std::perror(argv[1]);
+		return 1;
+	}
+
+	TraceRecord records[4096];
+	char line[128];
+	size_t count;
+	while((count = std::fread(records, sizeof(TraceRecord), 4096, f)) > 0){
+		for(size_t i = 0; i < count; i++){
+			FormatTrace(records[i], line);
+			std::fputs(line, stdout);
+		}
+	}
+
+	if(f != stdin) std::fclose(f);
+	return 0;
+}